@@ -51,6 +51,9 @@ __subsystem struct behavior_driver_api {
     behavior_keymap_binding_callback_t binding_released;
     behavior_sensor_keymap_binding_accept_data_callback_t sensor_binding_accept_data;
     behavior_sensor_keymap_binding_process_callback_t sensor_binding_process;
+    // Set to also receive sensor data, with process mode DISCARD, while the binding's layer is
+    // inactive or covered by an opaque binding on a higher layer.
+    bool sensor_binding_accepts_inactive_data;
 };
 /**
  * @endcond
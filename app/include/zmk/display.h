@@ -10,17 +10,44 @@
 
 #pragma once
 
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
 struct k_work_q *zmk_display_work_q(void);
 
 bool zmk_display_is_initialized(void);
 int zmk_display_init(void);
 
+/**
+ * @brief A pending UI update of one widget listener.
+ *
+ * Updates requested by any number of widgets within CONFIG_ZMK_DISPLAY_UPDATE_DELAY_MS are applied
+ * together in a single work item, followed by a single screen refresh.
+ */
+struct zmk_display_widget_update {
+    sys_snode_t node;
+    void (*update)(void);
+    atomic_t pending;
+};
+
+/**
+ * @brief Queue a widget update to be applied in the display queue context.
+ *
+ * Requesting an update that is already queued has no effect.
+ */
+void zmk_display_widget_request_update(struct zmk_display_widget_update *update);
+
 /**
  * @brief Macro to define a ZMK event listener that handles the thread safety of fetching
  * the necessary state from the system work queue context, invoking a work callback
  * in the display queue context, and properly accessing that state safely when performing
  * display/LVGL updates.
  *
+ * The callback is only invoked when the fetched state differs (bytewise) from the previous state,
+ * so events that don't change what a widget shows don't cause the display to redraw.
+ *
  * @param listener THe ZMK Event manager listener name.
  * @param state_type The struct/enum type used to store/transfer state.
  * @param cb The callback to invoke in the dispaly queue context to update the UI. Should be `void
@@ -39,21 +66,23 @@ int zmk_display_init(void);
         k_mutex_unlock(&listener##_mutex);                                                         \
         return copy;                                                                               \
     };                                                                                             \
-    static void listener##_work_cb(struct k_work *work) { cb(listener##_get_local_state()); };     \
-    K_WORK_DEFINE(listener##_work, listener##_work_cb);                                            \
-    static void listener##_refresh_state(const zmk_event_t *eh) {                                  \
+    static void listener##_update_cb(void) { cb(listener##_get_local_state()); };                  \
+    static struct zmk_display_widget_update listener##_update = {.update = listener##_update_cb};  \
+    static bool listener##_refresh_state(const zmk_event_t *eh) {                                  \
+        state_type state = state_func(eh);                                                         \
         k_mutex_lock(&listener##_mutex, K_FOREVER);                                                \
-        __##listener##_state = state_func(eh);                                                     \
+        bool changed = memcmp(&state, &__##listener##_state, sizeof(state_type)) != 0;             \
+        __##listener##_state = state;                                                              \
         k_mutex_unlock(&listener##_mutex);                                                         \
+        return changed;                                                                            \
     };                                                                                             \
     static void listener##_init() {                                                                \
         listener##_refresh_state(NULL);                                                            \
-        listener##_work_cb(NULL);                                                                  \
+        listener##_update_cb();                                                                    \
     }                                                                                              \
     static int listener##_cb(const zmk_event_t *eh) {                                              \
-        if (zmk_display_is_initialized()) {                                                        \
-            listener##_refresh_state(eh);                                                          \
-            k_work_submit_to_queue(zmk_display_work_q(), &listener##_work);                        \
+        if (zmk_display_is_initialized() && listener##_refresh_state(eh)) {                        \
+            zmk_display_widget_request_update(&listener##_update);                                 \
         }                                                                                          \
         return ZMK_EV_EVENT_BUBBLE;                                                                \
     }                                                                                              \
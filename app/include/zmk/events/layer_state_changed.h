@@ -8,17 +8,31 @@
 
 #include <zephyr/kernel.h>
 #include <zmk/event_manager.h>
+#include <zmk/keymap.h>
 
+// Raised once per change to the layer state, however many layers that change touched. layer and
+// state describe the highest layer that changed; old_state and new_state hold the full layer
+// state before and after the change.
 struct zmk_layer_state_changed {
     uint8_t layer;
     bool state;
+    zmk_keymap_layers_state_t old_state;
+    zmk_keymap_layers_state_t new_state;
     int64_t timestamp;
 };
 
 ZMK_EVENT_DECLARE(zmk_layer_state_changed);
 
-static inline struct zmk_layer_state_changed_event *create_layer_state_changed(uint8_t layer,
-                                                                               bool state) {
-    return new_zmk_layer_state_changed((struct zmk_layer_state_changed){
-        .layer = layer, .state = state, .timestamp = k_uptime_get()});
+static inline struct zmk_layer_state_changed_event *
+create_layer_state_changed(const zmk_keymap_layers_state_t *old_state,
+                           const zmk_keymap_layers_state_t *new_state) {
+    zmk_keymap_layers_state_t changed = zmk_keymap_layers_state_diff(old_state, new_state);
+    int layer = MAX(zmk_keymap_layers_state_highest(&changed), 0);
+
+    return new_zmk_layer_state_changed(
+        (struct zmk_layer_state_changed){.layer = layer,
+                                         .state = zmk_keymap_layers_state_test(new_state, layer),
+                                         .old_state = *old_state,
+                                         .new_state = *new_state,
+                                         .timestamp = k_uptime_get()});
 }
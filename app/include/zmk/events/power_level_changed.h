@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+#include <zmk/event_manager.h>
+#include <zmk/power_level.h>
+
+struct zmk_power_level_changed {
+    enum zmk_power_level level;
+};
+
+ZMK_EVENT_DECLARE(zmk_power_level_changed);
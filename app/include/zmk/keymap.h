@@ -6,24 +6,173 @@
 
 #pragma once
 
+#include <zephyr/sys/util.h>
+#include <zmk/behavior.h>
 #include <zmk/events/position_state_changed.h>
 
 #define ZMK_LAYER_CHILD_LEN_PLUS_ONE(node) 1 +
 #define ZMK_KEYMAP_LAYERS_LEN                                                                      \
     (DT_FOREACH_CHILD(DT_INST(0, zmk_keymap), ZMK_LAYER_CHILD_LEN_PLUS_ONE) 0)
 
-typedef uint32_t zmk_keymap_layers_state_t;
+#define ZMK_KEYMAP_LAYERS_STATE_WORD_BITS 32
+#define ZMK_KEYMAP_LAYERS_STATE_WORDS                                                              \
+    DIV_ROUND_UP(MAX(ZMK_KEYMAP_LAYERS_LEN, 1), ZMK_KEYMAP_LAYERS_STATE_WORD_BITS)
+#define ZMK_KEYMAP_LAYERS_STATE_MAX_LEN                                                            \
+    (ZMK_KEYMAP_LAYERS_STATE_WORDS * ZMK_KEYMAP_LAYERS_STATE_WORD_BITS)
+
+// Bitmap of layers, one bit per layer, spread over as many 32-bit words as the keymap needs.
+typedef struct {
+    uint32_t words[ZMK_KEYMAP_LAYERS_STATE_WORDS];
+} zmk_keymap_layers_state_t;
+
+#define ZMK_KEYMAP_LAYERS_STATE_WORD(layer) ((layer) / ZMK_KEYMAP_LAYERS_STATE_WORD_BITS)
+#define ZMK_KEYMAP_LAYERS_STATE_BIT(layer) BIT((layer) % ZMK_KEYMAP_LAYERS_STATE_WORD_BITS)
+
+static inline bool zmk_keymap_layers_state_test(const zmk_keymap_layers_state_t *state,
+                                                uint8_t layer) {
+    return (state->words[ZMK_KEYMAP_LAYERS_STATE_WORD(layer)] &
+            ZMK_KEYMAP_LAYERS_STATE_BIT(layer)) != 0;
+}
+
+static inline void zmk_keymap_layers_state_write(zmk_keymap_layers_state_t *state, uint8_t layer,
+                                                 bool value) {
+    if (value) {
+        state->words[ZMK_KEYMAP_LAYERS_STATE_WORD(layer)] |= ZMK_KEYMAP_LAYERS_STATE_BIT(layer);
+    } else {
+        state->words[ZMK_KEYMAP_LAYERS_STATE_WORD(layer)] &= ~ZMK_KEYMAP_LAYERS_STATE_BIT(layer);
+    }
+}
+
+static inline bool zmk_keymap_layers_state_equal(const zmk_keymap_layers_state_t *a,
+                                                 const zmk_keymap_layers_state_t *b) {
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        if (a->words[i] != b->words[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the layers whose state differs between a and b.
+static inline zmk_keymap_layers_state_t
+zmk_keymap_layers_state_diff(const zmk_keymap_layers_state_t *a,
+                             const zmk_keymap_layers_state_t *b) {
+    zmk_keymap_layers_state_t diff;
+
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        diff.words[i] = a->words[i] ^ b->words[i];
+    }
+    return diff;
+}
+
+// Returns true if every layer set in mask is also set in state.
+static inline bool zmk_keymap_layers_state_contains(const zmk_keymap_layers_state_t *state,
+                                                    const zmk_keymap_layers_state_t *mask) {
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        if ((state->words[i] & mask->words[i]) != mask->words[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns true if any layer set in mask is also set in state.
+static inline bool zmk_keymap_layers_state_intersects(const zmk_keymap_layers_state_t *state,
+                                                      const zmk_keymap_layers_state_t *mask) {
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        if (state->words[i] & mask->words[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the highest layer set in state that is strictly below the given layer, or -1 if there
+// is none. Each word is resolved with a single find-most-significant-bit (count leading zeros).
+static inline int zmk_keymap_layers_state_prev(const zmk_keymap_layers_state_t *state,
+                                               int layer) {
+    if (layer <= 0) {
+        return -1;
+    }
+
+    layer = MIN(layer, ZMK_KEYMAP_LAYERS_STATE_MAX_LEN) - 1;
+
+    int word = ZMK_KEYMAP_LAYERS_STATE_WORD(layer);
+    uint32_t bits = state->words[word] &
+                    (uint32_t)GENMASK(layer % ZMK_KEYMAP_LAYERS_STATE_WORD_BITS, 0);
+
+    while (bits == 0) {
+        if (--word < 0) {
+            return -1;
+        }
+        bits = state->words[word];
+    }
+
+    return word * ZMK_KEYMAP_LAYERS_STATE_WORD_BITS + find_msb_set(bits) - 1;
+}
+
+// Returns the highest layer set in state, or -1 if no layer is set.
+static inline int zmk_keymap_layers_state_highest(const zmk_keymap_layers_state_t *state) {
+    return zmk_keymap_layers_state_prev(state, ZMK_KEYMAP_LAYERS_STATE_MAX_LEN);
+}
+
+// Iterates over every layer set in state, from the highest layer down.
+#define ZMK_KEYMAP_LAYERS_STATE_FOREACH_DESC(state, layer)                                         \
+    for (layer = zmk_keymap_layers_state_highest(state); layer >= 0;                               \
+         layer = zmk_keymap_layers_state_prev(state, layer))
+
+// A batch of layer changes that is applied to the layer state, and reported to listeners, all at
+// once. Layers that are neither activated nor deactivated in the batch keep whatever state they
+// have when it is committed.
+struct zmk_keymap_layer_transaction {
+    zmk_keymap_layers_state_t activate;
+    zmk_keymap_layers_state_t deactivate;
+};
 
 uint8_t zmk_keymap_layer_default(void);
 zmk_keymap_layers_state_t zmk_keymap_layer_state(void);
+int zmk_keymap_layer_state_set(zmk_keymap_layers_state_t state);
 bool zmk_keymap_layer_active(uint8_t layer);
 uint8_t zmk_keymap_highest_layer_active(void);
 int zmk_keymap_layer_activate(uint8_t layer);
 int zmk_keymap_layer_deactivate(uint8_t layer);
 int zmk_keymap_layer_toggle(uint8_t layer);
 int zmk_keymap_layer_to(uint8_t layer);
+void zmk_keymap_layer_transaction_begin(struct zmk_keymap_layer_transaction *txn);
+int zmk_keymap_layer_transaction_activate(struct zmk_keymap_layer_transaction *txn, uint8_t layer);
+int zmk_keymap_layer_transaction_deactivate(struct zmk_keymap_layer_transaction *txn,
+                                            uint8_t layer);
+int zmk_keymap_layer_transaction_commit(struct zmk_keymap_layer_transaction *txn);
 const char *zmk_keymap_layer_name(uint8_t layer);
 
+const struct zmk_behavior_binding *zmk_keymap_get_layer_binding_at_idx(uint8_t layer,
+                                                                       uint32_t position);
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_RUNTIME)
+/**
+ * @brief Replace the binding at @p position on @p layer until it is changed again.
+ *
+ * The change takes effect immediately and, if settings are enabled, is written to flash once no
+ * further changes have been made for CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE milliseconds.
+ *
+ * @retval 0 on success.
+ * @retval -EINVAL if the layer or position is outside the keymap.
+ * @retval -ENODEV if no behavior with the binding's behavior name exists.
+ */
+int zmk_keymap_set_layer_binding_at_idx(uint8_t layer, uint32_t position,
+                                        struct zmk_behavior_binding binding);
+
+/**
+ * @brief Restore the binding at @p position on @p layer to the one defined in devicetree.
+ */
+int zmk_keymap_reset_layer_binding_at_idx(uint8_t layer, uint32_t position);
+
+/**
+ * @brief Write any pending binding changes to settings now instead of waiting for the debounce.
+ */
+int zmk_keymap_save_changes(void);
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_RUNTIME) */
+
 int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pressed,
                                       int64_t timestamp);
 
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ZMK_KEYMAP_PROTOCOL_VERSION 1
+
+// Frames on every transport are a length byte, counting the bytes that follow it, then a command
+// byte and the command's payload. Responses echo the command byte followed by a status byte, which
+// holds zero or a negative errno value, and the response payload. All integers are little endian.
+//
+// GET_INFO:      request  -
+//                response version(u8) layers(u8) positions(u16) max_behavior_name_len(u8)
+// GET_BINDING:   request  layer(u8) position(u16)
+//                response param1(u32) param2(u32) behavior_name(remaining bytes)
+// SET_BINDING:   request  layer(u8) position(u16) param1(u32) param2(u32)
+//                         behavior_name(remaining bytes)
+// RESET_BINDING: request  layer(u8) position(u16)
+// SAVE:          request  -
+enum zmk_keymap_protocol_cmd {
+    ZMK_KEYMAP_PROTOCOL_CMD_GET_INFO = 0x01,
+    ZMK_KEYMAP_PROTOCOL_CMD_GET_BINDING = 0x02,
+    ZMK_KEYMAP_PROTOCOL_CMD_SET_BINDING = 0x03,
+    ZMK_KEYMAP_PROTOCOL_CMD_RESET_BINDING = 0x04,
+    ZMK_KEYMAP_PROTOCOL_CMD_SAVE = 0x05,
+};
+
+#define ZMK_KEYMAP_PROTOCOL_BINDING_HEADER_LEN 11
+#define ZMK_KEYMAP_PROTOCOL_MAX_FRAME_LEN                                                          \
+    (2 + ZMK_KEYMAP_PROTOCOL_BINDING_HEADER_LEN + CONFIG_ZMK_KEYMAP_RUNTIME_BEHAVIOR_NAME_MAX_LEN)
+
+/**
+ * @brief Handle one complete request frame and write the response frame.
+ *
+ * Must be called from the system work queue, since it reads and modifies the keymap.
+ *
+ * @retval The length of the response frame written to @p resp.
+ * @retval -EINVAL if @p req is not a complete frame.
+ */
+int zmk_keymap_protocol_handle_frame(const uint8_t *req, size_t req_len, uint8_t *resp,
+                                     size_t resp_size);
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zmk/power_level.h>
+
+struct zmk_power_governor_stats {
+    // Number of times the power level has changed since boot.
+    uint32_t transitions;
+    // Total time spent at each power level since boot, including the current one.
+    uint32_t level_ms[ZMK_POWER_LEVEL_COUNT];
+};
+
+void zmk_power_governor_get_stats(struct zmk_power_governor_stats *stats);
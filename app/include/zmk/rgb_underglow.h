@@ -12,6 +12,20 @@ struct zmk_led_hsb {
     uint8_t b;
 };
 
+struct zmk_rgb_underglow_frame_stats {
+    // Number of frames rendered.
+    uint32_t frames;
+    // Number of rendered frames that changed the strip and were sent to it.
+    uint32_t updates;
+    // Number of frames dropped because an earlier frame ran past their time.
+    uint32_t skipped;
+    // Number of frames rendered at the throttled frame rate.
+    uint32_t throttled;
+    // Time taken to render and send the most recent frame, and the longest such time.
+    uint32_t last_frame_us;
+    uint32_t max_frame_us;
+};
+
 int zmk_rgb_underglow_toggle(void);
 int zmk_rgb_underglow_get_state(bool *state);
 int zmk_rgb_underglow_on(void);
@@ -27,3 +41,4 @@ int zmk_rgb_underglow_change_sat(int direction);
 int zmk_rgb_underglow_change_brt(int direction);
 int zmk_rgb_underglow_change_spd(int direction);
 int zmk_rgb_underglow_set_hsb(struct zmk_led_hsb color);
+int zmk_rgb_underglow_get_frame_stats(struct zmk_rgb_underglow_frame_stats *stats);
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/slist.h>
+
+// A subsystem's hook for writing its values to settings. Savers with pending changes are written
+// together in one batch once no save has been requested for CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE
+// milliseconds and the keyboard is not being typed on.
+struct zmk_settings_saver {
+    sys_snode_t node;
+    const char *name;
+    void (*save)(void);
+    atomic_t pending;
+};
+
+#define ZMK_SETTINGS_SAVER_DEFINE(var, save_fn)                                                    \
+    static struct zmk_settings_saver var = {.name = STRINGIFY(var), .save = save_fn}
+
+struct zmk_settings_save_stats {
+    // Number of batches written.
+    uint32_t commits;
+    // Number of times a batch was postponed because keys were in use.
+    uint32_t deferrals;
+    // Number of values written or deleted.
+    uint32_t entries;
+    // Number of value bytes written.
+    uint32_t bytes;
+};
+
+/**
+ * @brief Mark @p saver as having changes, to be written with the next batch.
+ */
+int zmk_settings_save_request(struct zmk_settings_saver *saver);
+
+/**
+ * @brief Write all pending changes now, without waiting for the debounce or for key activity to
+ * stop.
+ */
+int zmk_settings_save_now(void);
+
+/**
+ * @brief Write one value to settings and record it in the save statistics. Meant to be called by
+ * zmk_settings_saver save functions.
+ */
+int zmk_settings_save_one(const char *name, const void *value, size_t len);
+
+/**
+ * @brief Delete one value from settings and record it in the save statistics.
+ */
+int zmk_settings_delete(const char *name);
+
+void zmk_settings_save_get_stats(struct zmk_settings_save_stats *stats);
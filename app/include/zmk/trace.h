@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+
+enum zmk_trace_type {
+    // value is the new state of the key position.
+    ZMK_TRACE_POSITION = 1,
+    // usage is the HID usage, with the usage page in the upper 16 bits. value is the new state.
+    ZMK_TRACE_KEYCODE = 2,
+    // value is an enum zmk_trace_hold_tap_decision.
+    ZMK_TRACE_HOLD_TAP = 3,
+    // usage is the number of records dropped because the buffer was full.
+    ZMK_TRACE_DROPPED = 4,
+};
+
+enum zmk_trace_hold_tap_decision {
+    ZMK_TRACE_HOLD_TAP_TAP = 0,
+    ZMK_TRACE_HOLD_TAP_HOLD_INTERRUPT = 1,
+    ZMK_TRACE_HOLD_TAP_HOLD_TIMER = 2,
+    ZMK_TRACE_HOLD_TAP_RETRO_TAP = 3,
+};
+
+// Used as the position of records that aren't tied to a key position.
+#define ZMK_TRACE_NO_POSITION UINT16_MAX
+
+// The record as sent over a UART, preceded by a length byte holding sizeof(struct
+// zmk_trace_record). All integers are little endian.
+struct zmk_trace_record {
+    // Low 32 bits of the event's uptime in milliseconds.
+    uint32_t timestamp;
+    uint32_t usage;
+    uint16_t position;
+    // The highest active layer when the record was made.
+    uint8_t layer;
+    uint8_t type;
+    uint8_t value;
+} __packed;
+
+/**
+ * @brief Add a record to the trace buffer, to be sent from the low priority work queue.
+ *
+ * If the buffer is full the record is dropped, and a ZMK_TRACE_DROPPED record is sent once there
+ * is room again.
+ */
+void zmk_trace_record(enum zmk_trace_type type, uint16_t position, uint32_t usage, uint8_t value,
+                      int64_t timestamp);
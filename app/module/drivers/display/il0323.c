@@ -34,7 +34,7 @@ LOG_MODULE_REGISTER(il0323, CONFIG_DISPLAY_LOG_LEVEL);
 #define IL0323_PANEL_LAST_GATE (EPD_PANEL_HEIGHT - 1)
 #define IL0323_PANEL_FIRST_PAGE 0U
 #define IL0323_PANEL_LAST_PAGE (IL0323_NUMOF_PAGES - 1)
-#define IL0323_BUFFER_SIZE 1280
+#define IL0323_BUFFER_SIZE (IL0323_NUMOF_PAGES * EPD_PANEL_HEIGHT)
 
 struct il0323_cfg {
     struct gpio_dt_spec reset;
@@ -45,9 +45,21 @@ struct il0323_cfg {
 
 static uint8_t il0323_pwr[] = DT_INST_PROP(0, pwr);
 
+/* What the panel currently shows, one horizontally aligned page per byte, row by row. */
 static uint8_t last_buffer[IL0323_BUFFER_SIZE];
+/* The old or new data of the window being written, packed for the DTM commands. */
+static uint8_t window_buffer[IL0323_BUFFER_SIZE];
 static bool blanking_on = true;
 static bool init_clear_done = false;
+static bool partial_mode = false;
+static uint16_t partial_refreshes;
+
+static struct gpio_callback busy_cb;
+static K_SEM_DEFINE(busy_sem, 0, 1);
+static bool busy_irq = false;
+
+/* How long to wait for the BUSY interrupt before checking the pin anyway. */
+#define IL0323_BUSY_IRQ_TIMEOUT 100U
 
 static inline int il0323_write_cmd(const struct il0323_cfg *cfg, uint8_t cmd, uint8_t *data,
                                    size_t len) {
@@ -71,17 +83,45 @@ static inline int il0323_write_cmd(const struct il0323_cfg *cfg, uint8_t cmd, ui
     return 0;
 }
 
+static void il0323_busy_cb(const struct device *port, struct gpio_callback *cb, uint32_t pins) {
+    k_sem_give(&busy_sem);
+}
+
 static inline void il0323_busy_wait(const struct il0323_cfg *cfg) {
+    k_sem_reset(&busy_sem);
+
     int pin = gpio_pin_get_dt(&cfg->busy);
 
+    /*
+     * The BUSY interrupt wakes us up as soon as the panel is done. Without it, the pin is polled
+     * like it used to be.
+     */
     while (pin > 0) {
         __ASSERT(pin >= 0, "Failed to get pin level");
-        // LOG_DBG("wait %u", pin);
-        k_msleep(IL0323_BUSY_DELAY);
+        k_sem_take(&busy_sem, K_MSEC(busy_irq ? IL0323_BUSY_IRQ_TIMEOUT : IL0323_BUSY_DELAY));
         pin = gpio_pin_get_dt(&cfg->busy);
     }
 }
 
+/*
+ * Waits for the previous refresh to finish, and leaves the partial mode it was started in.
+ * Refreshes are not waited for when they are started, so the display queue is free while the
+ * panel updates.
+ */
+static int il0323_wait_ready(const struct il0323_cfg *cfg) {
+    il0323_busy_wait(cfg);
+
+    if (partial_mode) {
+        partial_mode = false;
+
+        if (il0323_write_cmd(cfg, IL0323_CMD_POUT, NULL, 0)) {
+            return -EIO;
+        }
+    }
+
+    return 0;
+}
+
 static int il0323_update_display(const struct device *dev) {
     const struct il0323_cfg *cfg = dev->config;
 
@@ -90,73 +130,154 @@ static int il0323_update_display(const struct device *dev) {
         return -EIO;
     }
 
-    k_msleep(IL0323_BUSY_DELAY);
-
     return 0;
 }
 
+/*
+ * Redraws the whole panel outside of partial mode, which clears the ghosting partial refreshes
+ * leave behind.
+ */
+static int il0323_full_refresh(const struct device *dev) {
+    const struct il0323_cfg *cfg = dev->config;
+
+    LOG_DBG("Full refresh");
+
+    if (il0323_wait_ready(cfg)) {
+        return -EIO;
+    }
+
+    if (il0323_write_cmd(cfg, IL0323_CMD_DTM1, last_buffer, IL0323_BUFFER_SIZE)) {
+        return -EIO;
+    }
+
+    if (il0323_write_cmd(cfg, IL0323_CMD_DTM2, last_buffer, IL0323_BUFFER_SIZE)) {
+        return -EIO;
+    }
+
+    partial_refreshes = 0;
+
+    return il0323_update_display(dev);
+}
+
+/* Packs a window of last_buffer into window_buffer. Returns the number of bytes packed. */
+static size_t il0323_pack_window(uint16_t first_page, uint16_t pages, uint16_t y, uint16_t rows) {
+    for (uint16_t row = 0; row < rows; row++) {
+        memcpy(&window_buffer[row * pages],
+               &last_buffer[(y + row) * IL0323_NUMOF_PAGES + first_page], pages);
+    }
+
+    return rows * pages;
+}
+
 static int il0323_write(const struct device *dev, const uint16_t x, const uint16_t y,
                         const struct display_buffer_descriptor *desc, const void *buf) {
     const struct il0323_cfg *cfg = dev->config;
     uint16_t x_end_idx = x + desc->width - 1;
     uint16_t y_end_idx = y + desc->height - 1;
     uint8_t ptl[IL0323_PTL_REG_LENGTH] = {0};
-    size_t buf_len;
+    const uint8_t *src = buf;
+    uint16_t src_pitch = desc->pitch / IL0323_PIXELS_PER_BYTE;
+    uint16_t first_page = x / IL0323_PIXELS_PER_BYTE;
+    uint16_t pages = desc->width / IL0323_PIXELS_PER_BYTE;
+    uint16_t min_page = UINT16_MAX, max_page = 0, min_row = UINT16_MAX, max_row = 0;
+    size_t len;
 
     LOG_DBG("x %u, y %u, height %u, width %u, pitch %u", x, y, desc->height, desc->width,
             desc->pitch);
 
-    buf_len = MIN(desc->buf_size, desc->height * desc->width / IL0323_PIXELS_PER_BYTE);
     __ASSERT(desc->width <= desc->pitch, "Pitch is smaller then width");
     __ASSERT(buf != NULL, "Buffer is not available");
-    __ASSERT(buf_len != 0U, "Buffer of length zero");
+    __ASSERT(!(x % IL0323_PIXELS_PER_BYTE), "X not multiple of %d", IL0323_PIXELS_PER_BYTE);
     __ASSERT(!(desc->width % IL0323_PIXELS_PER_BYTE), "Buffer width not multiple of %d",
              IL0323_PIXELS_PER_BYTE);
 
-    LOG_DBG("buf_len %d", buf_len);
     if ((y_end_idx > (EPD_PANEL_HEIGHT - 1)) || (x_end_idx > (EPD_PANEL_WIDTH - 1))) {
         LOG_ERR("Position out of bounds");
         return -EINVAL;
     }
 
+    if (desc->buf_size < (desc->height - 1) * src_pitch + pages) {
+        LOG_ERR("Buffer too small");
+        return -EINVAL;
+    }
+
+    /* Only the smallest window that covers every changed byte is sent to the panel. */
+    for (uint16_t row = 0; row < desc->height; row++) {
+        const uint8_t *old_row = &last_buffer[(y + row) * IL0323_NUMOF_PAGES + first_page];
+        const uint8_t *new_row = &src[row * src_pitch];
+
+        for (uint16_t page = 0; page < pages; page++) {
+            if (old_row[page] != new_row[page]) {
+                min_page = MIN(min_page, page);
+                max_page = MAX(max_page, page);
+                min_row = MIN(min_row, row);
+                max_row = MAX(max_row, row);
+            }
+        }
+    }
+
+    if (min_row == UINT16_MAX) {
+        LOG_DBG("Unchanged");
+        return 0;
+    }
+
+    /* The differences are in the window, so the old data is packed before it is updated. */
+    uint16_t win_page = first_page + min_page;
+    uint16_t win_pages = max_page - min_page + 1;
+    uint16_t win_y = y + min_row;
+    uint16_t win_rows = max_row - min_row + 1;
+
+    len = il0323_pack_window(win_page, win_pages, win_y, win_rows);
+
+    for (uint16_t row = min_row; row <= max_row; row++) {
+        memcpy(&last_buffer[(y + row) * IL0323_NUMOF_PAGES + win_page],
+               &src[row * src_pitch + min_page], win_pages);
+    }
+
+    if (!blanking_on && CONFIG_IL0323_FULL_REFRESH_INTERVAL > 0 &&
+        ++partial_refreshes >= CONFIG_IL0323_FULL_REFRESH_INTERVAL) {
+        return il0323_full_refresh(dev);
+    }
+
     /* Setup Partial Window and enable Partial Mode */
-    ptl[IL0323_PTL_HRST_IDX] = x;
-    ptl[IL0323_PTL_HRED_IDX] = x_end_idx;
-    ptl[IL0323_PTL_VRST_IDX] = y;
-    ptl[IL0323_PTL_VRED_IDX] = y_end_idx;
+    ptl[IL0323_PTL_HRST_IDX] = win_page * IL0323_PIXELS_PER_BYTE;
+    ptl[IL0323_PTL_HRED_IDX] = (win_page + win_pages) * IL0323_PIXELS_PER_BYTE - 1;
+    ptl[IL0323_PTL_VRST_IDX] = win_y;
+    ptl[IL0323_PTL_VRED_IDX] = win_y + win_rows - 1;
     ptl[sizeof(ptl) - 1] = IL0323_PTL_PT_SCAN;
     LOG_HEXDUMP_DBG(ptl, sizeof(ptl), "ptl");
 
-    il0323_busy_wait(cfg);
+    if (il0323_wait_ready(cfg)) {
+        return -EIO;
+    }
+
     if (il0323_write_cmd(cfg, IL0323_CMD_PIN, NULL, 0)) {
         return -EIO;
     }
 
+    partial_mode = true;
+
     if (il0323_write_cmd(cfg, IL0323_CMD_PTL, ptl, sizeof(ptl))) {
         return -EIO;
     }
 
-    if (il0323_write_cmd(cfg, IL0323_CMD_DTM1, last_buffer, IL0323_BUFFER_SIZE)) {
+    if (il0323_write_cmd(cfg, IL0323_CMD_DTM1, window_buffer, len)) {
         return -EIO;
     }
 
-    if (il0323_write_cmd(cfg, IL0323_CMD_DTM2, (uint8_t *)buf, buf_len)) {
+    il0323_pack_window(win_page, win_pages, win_y, win_rows);
+
+    if (il0323_write_cmd(cfg, IL0323_CMD_DTM2, window_buffer, len)) {
         return -EIO;
     }
 
-    memcpy(last_buffer, (uint8_t *)buf, IL0323_BUFFER_SIZE);
-
-    /* Update partial window and disable Partial Mode */
+    /* Update partial window. Partial Mode is disabled once the update is done. */
     if (blanking_on == false) {
         if (il0323_update_display(dev)) {
             return -EIO;
         }
     }
 
-    if (il0323_write_cmd(cfg, IL0323_CMD_POUT, NULL, 0)) {
-        return -EIO;
-    }
-
     return 0;
 }
 
@@ -180,6 +301,9 @@ static int il0323_clear_and_write_buffer(const struct device *dev, uint8_t patte
         return -ENOMEM;
     }
 
+    /* The panel contents are unknown, so make every line differ from what it supposedly shows. */
+    memset(last_buffer, ~pattern, IL0323_BUFFER_SIZE);
+
     memset(line, pattern, IL0323_NUMOF_PAGES);
     for (int i = 0; i < EPD_PANEL_HEIGHT; i++) {
         il0323_write(dev, 0, i, &desc, line);
@@ -201,8 +325,7 @@ static int il0323_blanking_off(const struct device *dev) {
 
     if (!init_clear_done) {
         /* Update EPD panel in normal mode */
-        il0323_busy_wait(cfg);
-        if (il0323_clear_and_write_buffer(dev, 0xff, true)) {
+        if (il0323_clear_and_write_buffer(dev, 0xff, false)) {
             return -EIO;
         }
         init_clear_done = true;
@@ -210,6 +333,11 @@ static int il0323_blanking_off(const struct device *dev) {
 
     blanking_on = false;
 
+    /* Changes written while blanked are shown in one refresh of the whole panel. */
+    if (il0323_wait_ready(cfg)) {
+        return -EIO;
+    }
+
     if (il0323_update_display(dev)) {
         return -EIO;
     }
@@ -367,6 +495,13 @@ static int il0323_init(const struct device *dev) {
 
     gpio_pin_configure_dt(&cfg->busy, GPIO_INPUT);
 
+    gpio_init_callback(&busy_cb, il0323_busy_cb, BIT(cfg->busy.pin));
+    busy_irq = gpio_add_callback(cfg->busy.port, &busy_cb) == 0 &&
+               gpio_pin_interrupt_configure_dt(&cfg->busy, GPIO_INT_EDGE_TO_INACTIVE) == 0;
+    if (!busy_irq) {
+        LOG_WRN("No interrupt for IL0323 busy signal, polling it instead");
+    }
+
     return il0323_controller_init(dev);
 }
 
@@ -36,11 +36,17 @@ struct reg_595_config {
 /** Runtime driver data */
 struct reg_595_drv_data {
     /* gpio_driver_data needs to be first */
-    struct gpio_driver_config data;
+    struct gpio_driver_data data;
 
     struct k_sem lock;
 
     uint32_t gpio_cache;
+
+    /* Set once gpio_cache matches what the registers actually hold */
+    bool gpio_cache_valid;
+
+    /* Kept out of the stack so the SPI driver can hand it straight to DMA */
+    uint8_t tx_data[4];
 };
 
 static int reg_595_write_registers(const struct device *dev, uint32_t value) {
@@ -48,12 +54,18 @@ static int reg_595_write_registers(const struct device *dev, uint32_t value) {
     struct reg_595_drv_data *const drv_data = (struct reg_595_drv_data *const)dev->data;
     int ret = 0;
 
+    /* The registers already hold this value, so there is no need to shift it out again */
+    if (drv_data->gpio_cache_valid && drv_data->gpio_cache == value) {
+        return 0;
+    }
+
     uint8_t nwrite = config->ngpios / 8;
-    uint32_t reg_data = sys_cpu_to_be32(value);
+
+    sys_put_be32(value, drv_data->tx_data);
 
     /* Allow a sequence of 1-4 registers in sequence, lowest byte is for the first in the chain */
     const struct spi_buf tx_buf[1] = {{
-        .buf = ((uint8_t *)&reg_data) + (4 - nwrite),
+        .buf = drv_data->tx_data + (4 - nwrite),
         .len = nwrite,
     }};
 
@@ -65,10 +77,12 @@ static int reg_595_write_registers(const struct device *dev, uint32_t value) {
     ret = spi_write_dt(&config->bus, &tx);
     if (ret < 0) {
         LOG_ERR("spi_write FAIL %d\n", ret);
+        drv_data->gpio_cache_valid = false;
         return ret;
     }
 
     drv_data->gpio_cache = value;
+    drv_data->gpio_cache_valid = true;
     return 0;
 }
 
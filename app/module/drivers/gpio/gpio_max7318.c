@@ -17,6 +17,7 @@
 #include <zephyr/init.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_utils.h>
 #include <zephyr/drivers/i2c.h>
 
 #define LOG_LEVEL CONFIG_GPIO_LOG_LEVEL
@@ -34,18 +35,24 @@ LOG_MODULE_REGISTER(gpio_max7318);
 #define REG_CONFIG_PORTA 0x06
 #define REG_CONFIG_PORTB 0x07
 
+#define MAX7318_HAS_INT DT_ANY_INST_HAS_PROP_STATUS_OKAY(int_gpios)
+
 // Configuration data
 struct max7318_config {
     struct gpio_driver_config common;
 
     struct i2c_dt_spec i2c_bus;
+#if MAX7318_HAS_INT
+    struct gpio_dt_spec int_gpio;
+    bool cache_inputs;
+#endif
     uint8_t ngpios;
 };
 
 // Runtime driver data
 struct max7318_drv_data {
     // gpio_driver_data needs to be first
-    struct gpio_driver_config data;
+    struct gpio_driver_data data;
 
     struct k_sem lock;
 
@@ -53,7 +60,30 @@ struct max7318_drv_data {
         uint16_t ipol;
         uint16_t config;
         uint16_t output;
+        uint16_t input;
     } reg_cache;
+
+    // Set while reg_cache.input may be reused, as long as INT hasn't asserted since it was read.
+    // Only used with cache-inputs, since the chip asserts INT whenever an input changes.
+    bool input_valid;
+
+#if MAX7318_HAS_INT
+    const struct device *dev;
+    struct gpio_callback int_callback;
+    struct k_work int_work;
+    // Counts INT assertions. A cached input value is only used while this still matches
+    // input_int_count, the count from before the value was read.
+    atomic_t int_count;
+    atomic_val_t input_int_count;
+    sys_slist_t callbacks;
+
+    struct k_spinlock int_lock;
+    // Pins with an interrupt enabled, split by which levels or edges trigger it.
+    uint16_t int_level_high;
+    uint16_t int_level_low;
+    uint16_t int_edge_rising;
+    uint16_t int_edge_falling;
+#endif
 };
 
 /**
@@ -114,6 +144,72 @@ static int write_registers(const struct device *dev, uint8_t reg, uint16_t value
     return i2c_burst_write_dt(&config->i2c_bus, reg, &data[0], sizeof(data));
 }
 
+/**
+ * @brief Write the output registers, unless they already hold the value
+ *
+ * Driving an output can change what the input registers read, so this also drops the cached
+ * input value.
+ *
+ * @param dev   The max7318 device.
+ * @param value The value to write.
+ *
+ * @return 0 if successful, failed otherwise.
+ */
+static int write_output_registers(const struct device *dev, uint16_t value) {
+    struct max7318_drv_data *const drv_data = (struct max7318_drv_data *const)dev->data;
+
+    if (value == drv_data->reg_cache.output) {
+        return 0;
+    }
+
+    int ret = write_registers(dev, REG_OUTPUT_PORTA, value);
+    if (ret == 0) {
+        drv_data->reg_cache.output = value;
+        drv_data->input_valid = false;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Read the input registers, or return the cached value if it is still current
+ *
+ * Reading the input registers also clears the chip's INT output.
+ *
+ * @param dev   The max7318 device.
+ * @param value Buffer to read data into.
+ *
+ * @return 0 if successful, failed otherwise.
+ */
+static int read_input_registers(const struct device *dev, uint16_t *value) {
+    struct max7318_drv_data *const drv_data = (struct max7318_drv_data *const)dev->data;
+
+#if MAX7318_HAS_INT
+    const struct max7318_config *config = dev->config;
+    const atomic_val_t int_count = atomic_get(&drv_data->int_count);
+
+    if (drv_data->input_valid && int_count == drv_data->input_int_count) {
+        *value = drv_data->reg_cache.input;
+        return 0;
+    }
+#endif
+
+    int ret = read_registers(dev, REG_INPUT_PORTA, &drv_data->reg_cache.input);
+    if (ret != 0) {
+        return ret;
+    }
+
+#if MAX7318_HAS_INT
+    // Compared against the count from before the read, so if INT fired during the read the next
+    // read goes to the chip again.
+    drv_data->input_int_count = int_count;
+    drv_data->input_valid = config->cache_inputs && config->int_gpio.port != NULL;
+#endif
+
+    *value = drv_data->reg_cache.input;
+    return 0;
+}
+
 /**
  * @brief Setup the pin direction (input or output)
  *
@@ -125,8 +221,8 @@ static int write_registers(const struct device *dev, uint8_t reg, uint16_t value
  */
 static int set_pin_direction(const struct device *dev, uint32_t pin, int flags) {
     struct max7318_drv_data *const drv_data = (struct max7318_drv_data *const)dev->data;
-    uint16_t *dir = &drv_data->reg_cache.config;
-    uint16_t *output = &drv_data->reg_cache.output;
+    uint16_t dir = drv_data->reg_cache.config;
+    uint16_t output = drv_data->reg_cache.output;
 
     /*
         The output register is 1=high, 0=low; the direction (config) register
@@ -134,21 +230,31 @@ static int set_pin_direction(const struct device *dev, uint32_t pin, int flags)
     */
     if ((flags & GPIO_OUTPUT) != 0U) {
         if ((flags & GPIO_OUTPUT_INIT_HIGH) != 0U) {
-            *output |= BIT(pin);
+            output |= BIT(pin);
         } else if ((flags & GPIO_OUTPUT_INIT_LOW) != 0U) {
-            *output &= ~BIT(pin);
+            output &= ~BIT(pin);
         }
-        *dir &= ~BIT(pin);
+        dir &= ~BIT(pin);
     } else {
-        *dir |= BIT(pin);
+        dir |= BIT(pin);
     }
 
-    int ret = write_registers(dev, REG_OUTPUT_PORTA, *output);
+    int ret = write_output_registers(dev, output);
     if (ret != 0) {
         return ret;
     }
 
-    return write_registers(dev, REG_CONFIG_PORTA, *dir);
+    if (dir == drv_data->reg_cache.config) {
+        return 0;
+    }
+
+    ret = write_registers(dev, REG_CONFIG_PORTA, dir);
+    if (ret == 0) {
+        drv_data->reg_cache.config = dir;
+        drv_data->input_valid = false;
+    }
+
+    return ret;
 }
 
 /**
@@ -216,7 +322,7 @@ static int max7318_port_get_raw(const struct device *dev, uint32_t *value) {
     k_sem_take(&drv_data->lock, K_FOREVER);
 
     uint16_t buf = 0;
-    int ret = read_registers(dev, REG_INPUT_PORTA, &buf);
+    int ret = read_input_registers(dev, &buf);
     if (ret != 0) {
         goto done;
     }
@@ -241,10 +347,7 @@ static int max7318_port_set_masked_raw(const struct device *dev, uint32_t mask,
     uint16_t buf = drv_data->reg_cache.output;
     buf = (buf & ~mask) | (mask & value);
 
-    int ret = write_registers(dev, REG_OUTPUT_PORTA, buf);
-    if (ret == 0) {
-        drv_data->reg_cache.output = buf;
-    }
+    int ret = write_output_registers(dev, buf);
 
     k_sem_give(&drv_data->lock);
     return ret;
@@ -271,20 +374,154 @@ static int max7318_port_toggle_bits(const struct device *dev, uint32_t mask) {
     uint16_t buf = drv_data->reg_cache.output;
     buf ^= mask;
 
-    int ret = write_registers(dev, REG_OUTPUT_PORTA, buf);
-    if (ret == 0) {
-        drv_data->reg_cache.output = buf;
-    }
+    int ret = write_output_registers(dev, buf);
 
     k_sem_give(&drv_data->lock);
     return ret;
 }
 
+#if MAX7318_HAS_INT
+/**
+ * @brief Read the inputs after the chip signals a change, and fire any callbacks which match
+ *
+ * The chip only asserts INT when an input changes, so level interrupts fire once when the pin
+ * reaches the level (or when the interrupt is enabled while it is already there) rather than
+ * repeatedly while it stays there.
+ */
+static void max7318_int_work_handler(struct k_work *work) {
+    struct max7318_drv_data *const drv_data =
+        CONTAINER_OF(work, struct max7318_drv_data, int_work);
+    const struct device *dev = drv_data->dev;
+
+    k_sem_take(&drv_data->lock, K_FOREVER);
+
+    uint16_t previous = drv_data->reg_cache.input;
+
+    // Always go to the chip here. That clears INT, and the cache may have been read before the
+    // change which triggered this.
+    drv_data->input_valid = false;
+
+    uint16_t input = 0;
+    int ret = read_input_registers(dev, &input);
+
+    k_sem_give(&drv_data->lock);
+
+    if (ret != 0) {
+        LOG_ERR("failed to read inputs after interrupt (%d)", ret);
+        return;
+    }
+
+    const uint16_t changed = input ^ previous;
+
+    k_spinlock_key_t key = k_spin_lock(&drv_data->int_lock);
+    const uint16_t fired = (drv_data->int_level_high & input) |
+                           (drv_data->int_level_low & ~input) |
+                           (drv_data->int_edge_rising & changed & input) |
+                           (drv_data->int_edge_falling & changed & ~input);
+    k_spin_unlock(&drv_data->int_lock, key);
+
+    if (fired) {
+        gpio_fire_callbacks(&drv_data->callbacks, dev, fired);
+    }
+}
+
+static void max7318_int_callback_handler(const struct device *port, struct gpio_callback *cb,
+                                         gpio_port_pins_t pins) {
+    struct max7318_drv_data *const drv_data =
+        CONTAINER_OF(cb, struct max7318_drv_data, int_callback);
+
+    atomic_inc(&drv_data->int_count);
+
+    // Can't do I2C bus operations from an ISR, so read the inputs from a work item.
+    k_work_submit(&drv_data->int_work);
+}
+#endif
+
 static int max7318_pin_interrupt_configure(const struct device *dev, gpio_pin_t pin,
                                            enum gpio_int_mode mode, enum gpio_int_trig trig) {
+#if MAX7318_HAS_INT
+    const struct max7318_config *const config = dev->config;
+    struct max7318_drv_data *const drv_data = (struct max7318_drv_data *const)dev->data;
+
+    if (config->int_gpio.port == NULL) {
+        return -ENOTSUP;
+    }
+
+    const bool high = (trig & GPIO_INT_TRIG_HIGH) != 0U;
+    const bool low = (trig & GPIO_INT_TRIG_LOW) != 0U;
+    const bool level = mode == GPIO_INT_MODE_LEVEL;
+    const bool edge = mode == GPIO_INT_MODE_EDGE;
+
+    k_spinlock_key_t key = k_spin_lock(&drv_data->int_lock);
+    WRITE_BIT(drv_data->int_level_high, pin, level && high);
+    WRITE_BIT(drv_data->int_level_low, pin, level && low);
+    WRITE_BIT(drv_data->int_edge_rising, pin, edge && high);
+    WRITE_BIT(drv_data->int_edge_falling, pin, edge && low);
+    k_spin_unlock(&drv_data->int_lock, key);
+
+    // A level interrupt must fire if the pin is already at that level.
+    if (level) {
+        k_work_submit(&drv_data->int_work);
+    }
+
+    return 0;
+#else
     return -ENOTSUP;
+#endif
 }
 
+#if MAX7318_HAS_INT
+static int max7318_manage_callback(const struct device *dev, struct gpio_callback *callback,
+                                   bool set) {
+    struct max7318_drv_data *const drv_data = (struct max7318_drv_data *const)dev->data;
+
+    return gpio_manage_callback(&drv_data->callbacks, callback, set);
+}
+#endif
+
+#if MAX7318_HAS_INT
+static int max7318_init_interrupt(const struct device *dev) {
+    const struct max7318_config *const config = dev->config;
+    struct max7318_drv_data *const drv_data = (struct max7318_drv_data *const)dev->data;
+
+    if (config->int_gpio.port == NULL) {
+        return 0;
+    }
+
+    if (!device_is_ready(config->int_gpio.port)) {
+        LOG_ERR("INT GPIO is not ready: %s", config->int_gpio.port->name);
+        return -ENODEV;
+    }
+
+    drv_data->dev = dev;
+    k_work_init(&drv_data->int_work, max7318_int_work_handler);
+
+    int ret = gpio_pin_configure_dt(&config->int_gpio, GPIO_INPUT);
+    if (ret != 0) {
+        LOG_ERR("unable to configure INT pin (%d)", ret);
+        return ret;
+    }
+
+    gpio_init_callback(&drv_data->int_callback, max7318_int_callback_handler,
+                       BIT(config->int_gpio.pin));
+    ret = gpio_add_callback(config->int_gpio.port, &drv_data->int_callback);
+    if (ret != 0) {
+        LOG_ERR("unable to add INT callback (%d)", ret);
+        return ret;
+    }
+
+    ret = gpio_pin_interrupt_configure_dt(&config->int_gpio, GPIO_INT_EDGE_TO_ACTIVE);
+    if (ret != 0) {
+        LOG_ERR("unable to configure INT interrupt (%d)", ret);
+        return ret;
+    }
+
+    // Read the inputs once to clear any pending INT and fill the input cache.
+    uint16_t input = 0;
+    return read_input_registers(dev, &input);
+}
+#endif
+
 static const struct gpio_driver_api api_table = {
     .pin_configure = max7318_config,
     .port_get_raw = max7318_port_get_raw,
@@ -293,6 +530,9 @@ static const struct gpio_driver_api api_table = {
     .port_clear_bits_raw = max7318_port_clear_bits_raw,
     .port_toggle_bits = max7318_port_toggle_bits,
     .pin_interrupt_configure = max7318_pin_interrupt_configure,
+#if MAX7318_HAS_INT
+    .manage_callback = max7318_manage_callback,
+#endif
 };
 
 /**
@@ -313,7 +553,12 @@ static int max7318_init(const struct device *dev) {
     LOG_INF("device initialised at 0x%x", config->i2c_bus.addr);
 
     k_sem_init(&drv_data->lock, 1, 1);
+
+#if MAX7318_HAS_INT
+    return max7318_init_interrupt(dev);
+#else
     return 0;
+#endif
 }
 
 #define GPIO_PORT_PIN_MASK_FROM_NGPIOS(ngpios) ((gpio_port_pins_t)(((uint64_t)1 << (ngpios)) - 1U))
@@ -321,10 +566,20 @@ static int max7318_init(const struct device *dev) {
 #define GPIO_PORT_PIN_MASK_FROM_DT_INST(inst)                                                      \
     GPIO_PORT_PIN_MASK_FROM_NGPIOS(DT_INST_PROP(inst, ngpios))
 
+#if MAX7318_HAS_INT
+#define MAX7318_INT_GPIO_INIT(inst)                                                                \
+    .int_gpio = GPIO_DT_SPEC_INST_GET_OR(inst, int_gpios, {0}),                                    \
+    .cache_inputs = DT_INST_PROP(inst, cache_inputs),
+#else
+#define MAX7318_INT_GPIO_INIT(inst)
+#endif
+
 #define MAX7318_INIT(inst)                                                                         \
     static struct max7318_config max7318_##inst##_config = {                                       \
         .common = {.port_pin_mask = GPIO_PORT_PIN_MASK_FROM_DT_INST(inst)},                        \
-        .i2c_bus = I2C_DT_SPEC_INST_GET(inst)};                                                    \
+        .i2c_bus = I2C_DT_SPEC_INST_GET(inst),                                                     \
+        MAX7318_INT_GPIO_INIT(inst)                                                                \
+    };                                                                                             \
                                                                                                    \
     static struct max7318_drv_data max7318_##inst##_drvdata = {                                    \
         /* Default for registers according to datasheet */                                         \
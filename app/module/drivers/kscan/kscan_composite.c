@@ -8,7 +8,11 @@
 
 #include <zephyr/device.h>
 #include <zephyr/drivers/kscan.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+
+#include <string.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #define MATRIX_NODE_ID DT_DRV_INST(0)
@@ -31,12 +35,99 @@ const struct kscan_composite_child_config kscan_composite_children[] = {
 
 struct kscan_composite_config {};
 
+struct kscan_composite_event {
+    uint16_t row;
+    uint16_t column;
+    bool pressed;
+};
+
 struct kscan_composite_data {
     kscan_callback_t callback;
 
     const struct device *dev;
+
+    /**
+     * Changes reported by any child since the last frame was sent, in the order they occurred.
+     */
+    struct kscan_composite_event frame[CONFIG_ZMK_KSCAN_COMPOSITE_FRAME_SIZE];
+    size_t frame_len;
+    struct k_spinlock lock;
+    struct k_work frame_work;
 };
 
+/**
+ * Send every change in the current frame downstream.
+ */
+static void kscan_composite_flush_frame(const struct device *dev) {
+    struct kscan_composite_data *data = dev->data;
+    struct kscan_composite_event frame[CONFIG_ZMK_KSCAN_COMPOSITE_FRAME_SIZE];
+    size_t frame_len;
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    frame_len = data->frame_len;
+    memcpy(frame, data->frame, frame_len * sizeof(frame[0]));
+    data->frame_len = 0;
+    k_spin_unlock(&data->lock, key);
+
+    for (int i = 0; i < frame_len; i++) {
+        data->callback(dev, frame[i].row, frame[i].column, frame[i].pressed);
+    }
+}
+
+static void kscan_composite_frame_work_handler(struct k_work *work) {
+    struct kscan_composite_data *data = CONTAINER_OF(work, struct kscan_composite_data, frame_work);
+
+    kscan_composite_flush_frame(data->dev);
+}
+
+/**
+ * Send the current frame before returning. Frames are always sent from the system work queue, so
+ * this can't overtake a frame that frame_work is sending at the same time.
+ */
+static void kscan_composite_flush_frame_sync(const struct device *dev) {
+    struct kscan_composite_data *data = dev->data;
+
+    if (k_current_get() == &k_sys_work_q.thread) {
+        // frame_work runs on this thread, so it can't be part way through sending a frame.
+        k_work_cancel(&data->frame_work);
+        kscan_composite_flush_frame(dev);
+        return;
+    }
+
+    struct k_work_sync sync;
+
+    k_work_submit(&data->frame_work);
+    k_work_flush(&data->frame_work, &sync);
+}
+
+/**
+ * Add a change to the current frame, starting a new frame if needed.
+ */
+static void kscan_composite_add_to_frame(const struct device *dev, const uint32_t row,
+                                         const uint32_t column, const bool pressed) {
+    struct kscan_composite_data *data = dev->data;
+
+    for (;;) {
+        k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+        if (data->frame_len < ARRAY_SIZE(data->frame)) {
+            data->frame[data->frame_len++] =
+                (struct kscan_composite_event){.row = row, .column = column, .pressed = pressed};
+            k_spin_unlock(&data->lock, key);
+            break;
+        }
+
+        k_spin_unlock(&data->lock, key);
+
+        // The frame is full. Send it now rather than dropping the change.
+        kscan_composite_flush_frame_sync(dev);
+    }
+
+    // Children scan from the system work queue, and any child scans which are due on the same
+    // tick are already queued, so the frame is sent once they have all run.
+    k_work_submit(&data->frame_work);
+}
+
 static int kscan_composite_enable_callback(const struct device *dev) {
     for (int i = 0; i < ARRAY_SIZE(kscan_composite_children); i++) {
         const struct kscan_composite_child_config *cfg = &kscan_composite_children[i];
@@ -52,6 +143,9 @@ static int kscan_composite_disable_callback(const struct device *dev) {
 
         kscan_disable_callback(cfg->child);
     }
+
+    // Send any changes the children reported before they stopped.
+    kscan_composite_flush_frame_sync(dev);
     return 0;
 }
 
@@ -59,7 +153,6 @@ static void kscan_composite_child_callback(const struct device *child_dev, uint3
                                            uint32_t column, bool pressed) {
     // TODO: Ideally we can get this passed into our callback!
     const struct device *dev = DEVICE_DT_GET(DT_DRV_INST(0));
-    struct kscan_composite_data *data = dev->data;
 
     for (int i = 0; i < ARRAY_SIZE(kscan_composite_children); i++) {
         const struct kscan_composite_child_config *cfg = &kscan_composite_children[i];
@@ -68,7 +161,8 @@ static void kscan_composite_child_callback(const struct device *child_dev, uint3
             continue;
         }
 
-        data->callback(dev, row + cfg->row_offset, column + cfg->column_offset, pressed);
+        kscan_composite_add_to_frame(dev, row + cfg->row_offset, column + cfg->column_offset,
+                                     pressed);
     }
 }
 
@@ -95,6 +189,8 @@ static int kscan_composite_init(const struct device *dev) {
 
     data->dev = dev;
 
+    k_work_init(&data->frame_work, kscan_composite_frame_work_handler);
+
     return 0;
 }
 
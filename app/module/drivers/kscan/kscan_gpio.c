@@ -31,3 +31,34 @@ int kscan_gpio_pin_get(const struct kscan_gpio *gpio, struct kscan_gpio_port_sta
 
     return (state->value & BIT(gpio->spec.pin)) != 0;
 }
+
+int kscan_gpio_list_set_all(const struct kscan_gpio_list *list, int value) {
+    size_t i = 0;
+
+    while (i < list->len) {
+        const struct device *port = list->gpios[i].spec.port;
+        gpio_port_pins_t mask = 0;
+
+        for (; i < list->len && list->gpios[i].spec.port == port; i++) {
+            mask |= BIT(list->gpios[i].spec.pin);
+        }
+
+        const int err = gpio_port_set_masked(port, mask, value ? mask : 0);
+        if (err) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+int kscan_gpio_pin_advance(const struct kscan_gpio *current, const struct kscan_gpio *next) {
+    if (next == NULL || next->spec.port != current->spec.port) {
+        return gpio_pin_set_dt(&current->spec, 0);
+    }
+
+    const gpio_port_pins_t mask = BIT(current->spec.pin) | BIT(next->spec.pin);
+    const int err = gpio_port_set_masked(current->spec.port, mask, BIT(next->spec.pin));
+
+    return err ? err : 1;
+}
@@ -59,3 +59,35 @@ void kscan_gpio_list_sort_by_port(struct kscan_gpio_list *list);
  * @retval -EWOULDBLOCK if operation would block.
  */
 int kscan_gpio_pin_get(const struct kscan_gpio *gpio, struct kscan_gpio_port_state *state);
+
+/**
+ * Set the logical level of every pin in a list.
+ *
+ * Consecutive pins on the same port are written with a single port write, so a list which is
+ * sorted by kscan_gpio_list_sort_by_port() costs one write per port instead of one write per pin.
+ * This matters for pins on external GPIO chips, where every write is a bus transaction.
+ *
+ * @param list The output pins to set.
+ * @param value The logical level to set.
+ *
+ * @retval 0 If successful.
+ * @retval -EIO I/O error when accessing an external GPIO chip.
+ * @retval -EWOULDBLOCK if operation would block.
+ */
+int kscan_gpio_list_set_all(const struct kscan_gpio_list *list, int value);
+
+/**
+ * Set an output pin inactive and, if it is on the same port, the next output pin active.
+ *
+ * Both changes are made with a single port write when possible. Otherwise, only the current pin
+ * is changed and the caller must set the next pin itself.
+ *
+ * @param current The output pin to set inactive.
+ * @param next The output pin to set active, or NULL if there is none.
+ *
+ * @retval 1 If the next pin was set active as well.
+ * @retval 0 If only the current pin was set inactive.
+ * @retval -EIO I/O error when accessing an external GPIO chip.
+ * @retval -EWOULDBLOCK if operation would block.
+ */
+int kscan_gpio_pin_advance(const struct kscan_gpio *current, const struct kscan_gpio *next);
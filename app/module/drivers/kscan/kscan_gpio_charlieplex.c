@@ -5,6 +5,7 @@
  */
 
 #include <zmk/debounce.h>
+#include <zmk/power_level.h>
 
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
@@ -59,12 +60,41 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #define KSCAN_INTR_CFG_INIT(inst_idx) GPIO_DT_SPEC_GET(DT_DRV_INST(inst_idx), interrupt_gpios)
 
+#define CALIBRATE_SETTLE IS_ENABLED(CONFIG_ZMK_KSCAN_CHARLIEPLEX_CALIBRATE_SETTLE)
+#define CALIBRATE_SETTLE_MAX_US 100
+
+struct kscan_charlieplex_port {
+    const struct device *port;
+    /** Mask of the cell pins on this port. */
+    gpio_port_pins_t mask;
+    /** Cell pin values from the most recent read, masked by the above. */
+    gpio_port_value_t value;
+};
+
+struct kscan_charlieplex_cell {
+    /** Flags to configure the pin as a pulled input. */
+    gpio_flags_t input_flags;
+    /** Flags to configure the pin as an active output. */
+    gpio_flags_t output_flags;
+    /** Index of the pin's port in data->ports. */
+    uint8_t port;
+    /** Time to wait after the pin stops driving before the next pin is driven. */
+    uint16_t settle_us;
+};
+
 struct kscan_charlieplex_data {
     const struct device *dev;
     kscan_callback_t callback;
     struct k_work_delayable work;
     int64_t scan_time; /* Timestamp of the current or scheduled scan. */
     struct gpio_callback irq_callback;
+    /** Whether every cell is known to be configured as an input. */
+    bool cells_idle;
+    /** Array of length config->cells.len */
+    struct kscan_charlieplex_cell *cells;
+    /** Array of the ports used by cells, with room for one per cell. */
+    struct kscan_charlieplex_port *ports;
+    size_t ports_len;
     /**
      * Current state of the matrix as a flattened 2D array of length
      * (config->cells.length ^2)
@@ -121,21 +151,32 @@ static int kscan_charlieplex_set_as_input(const struct gpio_dt_spec *gpio) {
     return 0;
 }
 
-static int kscan_charlieplex_set_as_output(const struct gpio_dt_spec *gpio) {
-    if (!device_is_ready(gpio->port)) {
-        LOG_ERR("GPIO is not ready: %s", gpio->port->name);
-        return -ENODEV;
-    }
+/**
+ * Configure a cell as an input using its precomputed flags.
+ */
+static int kscan_charlieplex_release_cell(const struct device *dev, const int idx) {
+    const struct kscan_charlieplex_config *config = dev->config;
+    const struct kscan_charlieplex_data *data = dev->data;
+    const struct gpio_dt_spec *gpio = &config->cells.gpios[idx];
 
-    int err = gpio_pin_configure_dt(gpio, GPIO_OUTPUT);
+    int err = gpio_pin_configure(gpio->port, gpio->pin, data->cells[idx].input_flags);
     if (err) {
-        LOG_ERR("Unable to configure pin %u on %s for output", gpio->pin, gpio->port->name);
-        return err;
+        LOG_ERR("Unable to configure pin %u on %s for input", gpio->pin, gpio->port->name);
     }
+    return err;
+}
+
+/**
+ * Configure a cell as an active output using its precomputed flags.
+ */
+static int kscan_charlieplex_drive_cell(const struct device *dev, const int idx) {
+    const struct kscan_charlieplex_config *config = dev->config;
+    const struct kscan_charlieplex_data *data = dev->data;
+    const struct gpio_dt_spec *gpio = &config->cells.gpios[idx];
 
-    err = gpio_pin_set_dt(gpio, 1);
+    int err = gpio_pin_configure(gpio->port, gpio->pin, data->cells[idx].output_flags);
     if (err) {
-        LOG_ERR("Failed to set output pin %u active: %i", gpio->pin, err);
+        LOG_ERR("Unable to configure pin %u on %s for output", gpio->pin, gpio->port->name);
     }
     return err;
 }
@@ -144,7 +185,7 @@ static int kscan_charlieplex_set_all_as_input(const struct device *dev) {
     const struct kscan_charlieplex_config *config = dev->config;
     int err = 0;
     for (int i = 0; i < config->cells.len; i++) {
-        err = kscan_charlieplex_set_as_input(&config->cells.gpios[i]);
+        err = kscan_charlieplex_release_cell(dev, i);
         if (err) {
             return err;
         }
@@ -194,6 +235,9 @@ static int kscan_charlieplex_interrupt_enable(const struct device *dev) {
         return err;
     }
 
+    struct kscan_charlieplex_data *data = dev->data;
+    data->cells_idle = false;
+
     // While interrupts are enabled, set all outputs active so an pressed key will trigger
     return kscan_charlieplex_set_all_outputs(dev, 1);
 }
@@ -226,29 +270,116 @@ static void kscan_charlieplex_read_end(const struct device *dev) {
         // Return to waiting for an interrupt.
         kscan_charlieplex_interrupt_enable(dev);
     } else {
-        data->scan_time += config->poll_period_ms;
+        data->scan_time += zmk_power_level_scale_ms(config->poll_period_ms);
 
         // Return to polling slowly.
         k_work_reschedule(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
     }
 }
 
+/**
+ * Busy wait until at least wait_us microseconds have passed since start_cycles.
+ */
+static void kscan_charlieplex_wait_since(const uint32_t start_cycles, const uint32_t wait_us) {
+    if (wait_us == 0) {
+        return;
+    }
+
+    // The cycle counter may be coarse, so count only whole cycles which have certainly passed.
+    const uint32_t elapsed_cycles = k_cycle_get_32() - start_cycles;
+    const uint32_t elapsed_us = k_cyc_to_us_floor32(MAX(elapsed_cycles, 1) - 1);
+    if (elapsed_us < wait_us) {
+        k_busy_wait(wait_us - elapsed_us);
+    }
+}
+
+/**
+ * Read every port used by the cells once, storing the values in data->ports.
+ */
+static int kscan_charlieplex_read_ports(const struct device *dev) {
+    struct kscan_charlieplex_data *data = dev->data;
+
+    for (int i = 0; i < data->ports_len; i++) {
+        struct kscan_charlieplex_port *port = &data->ports[i];
+
+        const int err = gpio_port_get(port->port, &port->value);
+        if (err) {
+            LOG_ERR("Failed to read port %s: %i", port->port->name, err);
+            return err;
+        }
+
+        port->value &= port->mask;
+    }
+
+    return 0;
+}
+
+/**
+ * Debounce the inputs read while one cell was driven and report any keys which changed state.
+ *
+ * @returns true if any key on the row is pressed or still being debounced.
+ */
+static bool kscan_charlieplex_process_row(const struct device *dev, const int row) {
+    struct kscan_charlieplex_data *data = dev->data;
+    const struct kscan_charlieplex_config *config = dev->config;
+    bool active_row = false;
+
+    for (int col = 0; col < config->cells.len; col++) {
+        if (col == row) {
+            continue; // pin can't drive itself
+        }
+
+        const struct gpio_dt_spec *in_gpio = &config->cells.gpios[col];
+        const struct kscan_charlieplex_port *port = &data->ports[data->cells[col].port];
+        const bool active = (port->value & BIT(in_gpio->pin)) != 0;
+        const int index = state_index(config, row, col);
+
+        struct zmk_debounce_state *state = &data->charlieplex_state[index];
+        zmk_debounce_update(state, active, config->debounce_scan_period_ms,
+                            &config->debounce_config);
+
+        // NOTE: RR vs MATRIX: because we don't need an input/output => row/column
+        // setup, we can update in the same loop.
+        if (zmk_debounce_get_changed(state)) {
+            const bool pressed = zmk_debounce_is_pressed(state);
+
+            LOG_DBG("Sending event at %i,%i state %s", row, col, pressed ? "on" : "off");
+            data->callback(dev, row, col, pressed);
+        }
+        active_row = active_row || zmk_debounce_is_active(state);
+    }
+
+    return active_row;
+}
+
 static int kscan_charlieplex_read(const struct device *dev) {
     struct kscan_charlieplex_data *data = dev->data;
     const struct kscan_charlieplex_config *config = dev->config;
     bool continue_scan = false;
+    int err;
 
-    // NOTE: RR vs MATRIX: set all pins as input, in case there was a failure on a
-    // previous scan, and one of the pins is still set as output
-    int err = kscan_charlieplex_set_all_as_input(dev);
-    if (err) {
-        return err;
+    // NOTE: RR vs MATRIX: set all pins as input if they were left driven by interrupt mode or
+    // a failure on a previous scan.
+    if (!data->cells_idle) {
+        err = kscan_charlieplex_set_all_as_input(dev);
+        if (err) {
+            return err;
+        }
     }
 
-    // Scan the matrix.
+    // Cleared until the scan finishes, since a failure may leave a pin driven.
+    data->cells_idle = false;
+
+    // When the previous row stopped driving.
+    uint32_t settle_start = k_cycle_get_32();
+    uint32_t settle_us = 0;
+
+    // Scan the matrix. Each row is read with one read per port, then released, and its keys are
+    // processed while the released pin settles.
     for (int row = 0; row < config->cells.len; row++) {
-        const struct gpio_dt_spec *out_gpio = &config->cells.gpios[row];
-        err = kscan_charlieplex_set_as_output(out_gpio);
+        kscan_charlieplex_wait_since(settle_start, settle_us);
+
+        err = kscan_charlieplex_drive_cell(dev, row);
         if (err) {
             return err;
         }
@@ -257,37 +388,24 @@ static int kscan_charlieplex_read(const struct device *dev) {
         k_busy_wait(CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BEFORE_INPUTS);
 #endif
 
-        for (int col = 0; col < config->cells.len; col++) {
-            if (col == row) {
-                continue; // pin can't drive itself
-            }
-            const struct gpio_dt_spec *in_gpio = &config->cells.gpios[col];
-            const int index = state_index(config, row, col);
-
-            struct zmk_debounce_state *state = &data->charlieplex_state[index];
-            zmk_debounce_update(state, gpio_pin_get_dt(in_gpio), config->debounce_scan_period_ms,
-                                &config->debounce_config);
-
-            // NOTE: RR vs MATRIX: because we don't need an input/output => row/column
-            // setup, we can update in the same loop.
-            if (zmk_debounce_get_changed(state)) {
-                const bool pressed = zmk_debounce_is_pressed(state);
-
-                LOG_DBG("Sending event at %i,%i state %s", row, col, pressed ? "on" : "off");
-                data->callback(dev, row, col, pressed);
-            }
-            continue_scan = continue_scan || zmk_debounce_is_active(state);
+        err = kscan_charlieplex_read_ports(dev);
+        if (err) {
+            return err;
         }
 
-        err = kscan_charlieplex_set_as_input(out_gpio);
+        err = kscan_charlieplex_release_cell(dev, row);
         if (err) {
             return err;
         }
-#if CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BETWEEN_OUTPUTS > 0
-        k_busy_wait(CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BETWEEN_OUTPUTS);
-#endif
+
+        settle_start = k_cycle_get_32();
+        settle_us = data->cells[row].settle_us;
+
+        continue_scan = kscan_charlieplex_process_row(dev, row) || continue_scan;
     }
 
+    data->cells_idle = true;
+
     if (continue_scan) {
         // At least one key is pressed or the debouncer has not yet decided if
         // it is pressed. Poll quickly until everything is released.
@@ -337,17 +455,83 @@ static int kscan_charlieplex_disable(const struct device *dev) {
 
 static int kscan_charlieplex_init_inputs(const struct device *dev) {
     const struct kscan_charlieplex_config *config = dev->config;
+    struct kscan_charlieplex_data *data = dev->data;
+
+    data->ports_len = 0;
 
     for (int i = 0; i < config->cells.len; i++) {
-        int err = kscan_charlieplex_set_as_input(&config->cells.gpios[i]);
+        const struct gpio_dt_spec *gpio = &config->cells.gpios[i];
+        struct kscan_charlieplex_cell *cell = &data->cells[i];
+
+        int err = kscan_charlieplex_set_as_input(gpio);
         if (err) {
             return err;
         }
+
+        // Precompute the flags for switching the pin between input and output, so the scan
+        // doesn't need to build them for every row.
+        const gpio_flags_t pull_flag =
+            ((gpio->dt_flags & GPIO_ACTIVE_LOW) == GPIO_ACTIVE_LOW) ? GPIO_PULL_UP : GPIO_PULL_DOWN;
+
+        cell->input_flags = gpio->dt_flags | GPIO_INPUT | pull_flag;
+        cell->output_flags = gpio->dt_flags | GPIO_OUTPUT_ACTIVE;
+        cell->settle_us = CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BETWEEN_OUTPUTS;
+
+        // Group the pins by port so each row costs one read per port.
+        int port = 0;
+        while (port < data->ports_len && data->ports[port].port != gpio->port) {
+            port++;
+        }
+
+        if (port == data->ports_len) {
+            data->ports[data->ports_len++] = (struct kscan_charlieplex_port){.port = gpio->port};
+        }
+
+        data->ports[port].mask |= BIT(gpio->pin);
+        cell->port = port;
     }
 
+    data->cells_idle = true;
+
     return 0;
 }
 
+#if CALIBRATE_SETTLE
+/**
+ * Measure how long each pin takes to return to inactive after it stops driving, and use that as
+ * its settle time, unless CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BETWEEN_OUTPUTS is longer.
+ */
+static void kscan_charlieplex_calibrate_settle(const struct device *dev) {
+    const struct kscan_charlieplex_config *config = dev->config;
+    struct kscan_charlieplex_data *data = dev->data;
+
+    for (int i = 0; i < config->cells.len; i++) {
+        const struct gpio_dt_spec *gpio = &config->cells.gpios[i];
+        struct kscan_charlieplex_cell *cell = &data->cells[i];
+
+        if (kscan_charlieplex_drive_cell(dev, i) || kscan_charlieplex_release_cell(dev, i)) {
+            continue;
+        }
+
+        int elapsed_us = 0;
+        while (gpio_pin_get_dt(gpio) > 0 && elapsed_us < CALIBRATE_SETTLE_MAX_US) {
+            k_busy_wait(1);
+            elapsed_us++;
+        }
+
+        if (elapsed_us >= CALIBRATE_SETTLE_MAX_US) {
+            LOG_WRN("Pin %u on %s did not settle within %d us", gpio->pin, gpio->port->name,
+                    CALIBRATE_SETTLE_MAX_US);
+        }
+
+        // Double the measurement as a margin for temperature and supply variation.
+        cell->settle_us = MAX(cell->settle_us, MIN(2 * elapsed_us, CALIBRATE_SETTLE_MAX_US));
+
+        LOG_DBG("Pin %u on %s settles in %d us", gpio->pin, gpio->port->name, cell->settle_us);
+    }
+}
+#endif
+
 static int kscan_charlieplex_init_interrupt(const struct device *dev) {
     struct kscan_charlieplex_data *data = dev->data;
 
@@ -372,7 +556,10 @@ static int kscan_charlieplex_init(const struct device *dev) {
     data->dev = dev;
 
     kscan_charlieplex_init_inputs(dev);
-    kscan_charlieplex_set_all_outputs(dev, 0);
+
+#if CALIBRATE_SETTLE
+    kscan_charlieplex_calibrate_settle(dev);
+#endif
 
     const struct kscan_charlieplex_config *config = dev->config;
     if (config->use_interrupt) {
@@ -397,7 +584,11 @@ static const struct kscan_driver_api kscan_charlieplex_api = {
     static struct zmk_debounce_state kscan_charlieplex_state_##n[INST_CHARLIEPLEX_LEN(n)];         \
     static const struct gpio_dt_spec kscan_charlieplex_cells_##n[] = {                             \
         LISTIFY(INST_LEN(n), KSCAN_GPIO_CFG_INIT, (, ), n)};                                       \
+    static struct kscan_charlieplex_cell kscan_charlieplex_cell_data_##n[INST_LEN(n)];             \
+    static struct kscan_charlieplex_port kscan_charlieplex_ports_##n[INST_LEN(n)];                 \
     static struct kscan_charlieplex_data kscan_charlieplex_data_##n = {                            \
+        .cells = kscan_charlieplex_cell_data_##n,                                                  \
+        .ports = kscan_charlieplex_ports_##n,                                                      \
         .charlieplex_state = kscan_charlieplex_state_##n,                                          \
     };                                                                                             \
                                                                                                    \
@@ -15,6 +15,7 @@
 #include <zephyr/sys/util.h>
 
 #include <zmk/debounce.h>
+#include <zmk/power_level.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -160,7 +161,7 @@ static void kscan_direct_read_end(const struct device *dev) {
     struct kscan_direct_data *data = dev->data;
     const struct kscan_direct_config *config = dev->config;
 
-    data->scan_time += config->poll_period_ms;
+    data->scan_time += zmk_power_level_scale_ms(config->poll_period_ms);
 
     // Return to polling slowly.
     k_work_reschedule(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
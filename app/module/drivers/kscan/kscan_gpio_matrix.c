@@ -16,6 +16,7 @@
 #include <zephyr/sys/util.h>
 
 #include <zmk/debounce.h>
+#include <zmk/power_level.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -66,9 +67,20 @@ struct kscan_matrix_irq_callback {
     struct gpio_callback callback;
 };
 
+struct kscan_matrix_port {
+    const struct device *port;
+    /** Mask of the input pins on this port. */
+    gpio_port_pins_t mask;
+    /** Input pin values from the most recent read, masked by the above. */
+    gpio_port_value_t value;
+};
+
 struct kscan_matrix_data {
     const struct device *dev;
     struct kscan_gpio_list inputs;
+    /** Array of the ports used by inputs, in the same order as the sorted inputs. */
+    struct kscan_matrix_port *ports;
+    size_t ports_len;
     kscan_callback_t callback;
     struct k_work_delayable work;
 #if USE_INTERRUPTS
@@ -117,14 +129,10 @@ static int state_index_io(const struct kscan_matrix_config *config, const int in
 static int kscan_matrix_set_all_outputs(const struct device *dev, const int value) {
     const struct kscan_matrix_config *config = dev->config;
 
-    for (int i = 0; i < config->outputs.len; i++) {
-        const struct gpio_dt_spec *gpio = &config->outputs.gpios[i].spec;
-
-        int err = gpio_pin_set_dt(gpio, value);
-        if (err) {
-            LOG_ERR("Failed to set output %i to %i: %i", i, value, err);
-            return err;
-        }
+    int err = kscan_gpio_list_set_all(&config->outputs, value);
+    if (err) {
+        LOG_ERR("Failed to set outputs to %i: %i", value, err);
+        return err;
     }
 
     return 0;
@@ -207,74 +215,161 @@ static void kscan_matrix_read_end(const struct device *dev) {
     struct kscan_matrix_data *data = dev->data;
     const struct kscan_matrix_config *config = dev->config;
 
-    data->scan_time += config->poll_period_ms;
+    data->scan_time += zmk_power_level_scale_ms(config->poll_period_ms);
 
     // Return to polling slowly.
     k_work_reschedule(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
 #endif
 }
 
-static int kscan_matrix_read(const struct device *dev) {
+/**
+ * Busy wait until at least wait_us microseconds have passed since start_cycles.
+ */
+static void kscan_matrix_wait_since(const uint32_t start_cycles, const uint32_t wait_us) {
+    if (wait_us == 0) {
+        return;
+    }
+
+    // The cycle counter may be coarse, so count only whole cycles which have certainly passed.
+    const uint32_t elapsed_cycles = k_cycle_get_32() - start_cycles;
+    const uint32_t elapsed_us = k_cyc_to_us_floor32(MAX(elapsed_cycles, 1) - 1);
+    if (elapsed_us < wait_us) {
+        k_busy_wait(wait_us - elapsed_us);
+    }
+}
+
+/**
+ * Read every input port once, storing the values in data->ports.
+ */
+static int kscan_matrix_read_ports(const struct device *dev) {
     struct kscan_matrix_data *data = dev->data;
-    const struct kscan_matrix_config *config = dev->config;
 
-    // Scan the matrix.
-    for (int i = 0; i < config->outputs.len; i++) {
-        const struct kscan_gpio *out_gpio = &config->outputs.gpios[i];
+    for (int i = 0; i < data->ports_len; i++) {
+        struct kscan_matrix_port *port = &data->ports[i];
 
-        int err = gpio_pin_set_dt(&out_gpio->spec, 1);
+        const int err = gpio_port_get(port->port, &port->value);
         if (err) {
-            LOG_ERR("Failed to set output %i active: %i", out_gpio->index, err);
+            LOG_ERR("Failed to read port %s: %i", port->port->name, err);
             return err;
         }
 
-#if CONFIG_ZMK_KSCAN_MATRIX_WAIT_BEFORE_INPUTS > 0
-        k_busy_wait(CONFIG_ZMK_KSCAN_MATRIX_WAIT_BEFORE_INPUTS);
-#endif
-        struct kscan_gpio_port_state state = {0};
+        port->value &= port->mask;
+    }
+
+    return 0;
+}
+
+/**
+ * Debounce the inputs read for one output and report any keys which changed state.
+ *
+ * @returns true if any key on the output is pressed or still being debounced.
+ */
+static bool kscan_matrix_process_output(const struct device *dev,
+                                        const struct kscan_gpio *out_gpio) {
+    struct kscan_matrix_data *data = dev->data;
+    const struct kscan_matrix_config *config = dev->config;
+
+    const struct kscan_matrix_port *port = data->ports;
+    bool active_output = false;
+
+    for (int i = 0; i < data->inputs.len; i++) {
+        const struct kscan_gpio *in_gpio = &data->inputs.gpios[i];
+
+        // Inputs are sorted by port, in the same order as data->ports.
+        if (in_gpio->spec.port != port->port) {
+            port++;
+        }
 
-        for (int j = 0; j < data->inputs.len; j++) {
-            const struct kscan_gpio *in_gpio = &data->inputs.gpios[j];
+        const bool active = (port->value & BIT(in_gpio->spec.pin)) != 0;
+        const int index = state_index_io(config, in_gpio->index, out_gpio->index);
+        struct zmk_debounce_state *state = &data->matrix_state[index];
 
-            const int index = state_index_io(config, in_gpio->index, out_gpio->index);
-            const int active = kscan_gpio_pin_get(in_gpio, &state);
-            if (active < 0) {
-                LOG_ERR("Failed to read port %s: %i", in_gpio->spec.port->name, active);
-                return active;
+        zmk_debounce_update(state, active, config->debounce_scan_period_ms,
+                            &config->debounce_config);
+
+        if (zmk_debounce_get_changed(state)) {
+            const bool pressed = zmk_debounce_is_pressed(state);
+            const bool row2col = config->diode_direction == KSCAN_ROW2COL;
+            const int row = row2col ? out_gpio->index : in_gpio->index;
+            const int col = row2col ? in_gpio->index : out_gpio->index;
+
+            LOG_DBG("Sending event at %i,%i state %s", row, col, pressed ? "on" : "off");
+            data->callback(dev, row, col, pressed);
+        }
+
+        active_output = active_output || zmk_debounce_is_active(state);
+    }
+
+    return active_output;
+}
+
+static int kscan_matrix_read(const struct device *dev) {
+    const struct kscan_matrix_config *config = dev->config;
+
+    // Whether the current output was already set active while processing the previous one.
+    bool output_active = false;
+    // When the current output was set active, or the previous one set inactive.
+    uint32_t settle_start = k_cycle_get_32();
+
+    bool continue_scan = false;
+
+    // Scan the matrix. Each output is read as soon as it has settled, and the next output is
+    // driven before the inputs which were just read are processed, so the next output settles
+    // while the debouncing and reporting for this one runs.
+    for (int i = 0; i < config->outputs.len; i++) {
+        const struct kscan_gpio *out_gpio = &config->outputs.gpios[i];
+        int err;
+
+        if (!output_active) {
+            kscan_matrix_wait_since(settle_start, CONFIG_ZMK_KSCAN_MATRIX_WAIT_BETWEEN_OUTPUTS);
+
+            err = gpio_pin_set_dt(&out_gpio->spec, 1);
+            if (err) {
+                LOG_ERR("Failed to set output %i active: %i", out_gpio->index, err);
+                return err;
             }
 
-            zmk_debounce_update(&data->matrix_state[index], active, config->debounce_scan_period_ms,
-                                &config->debounce_config);
+            settle_start = k_cycle_get_32();
         }
 
-        err = gpio_pin_set_dt(&out_gpio->spec, 0);
+        kscan_matrix_wait_since(settle_start, CONFIG_ZMK_KSCAN_MATRIX_WAIT_BEFORE_INPUTS);
+
+        err = kscan_matrix_read_ports(dev);
         if (err) {
-            LOG_ERR("Failed to set output %i inactive: %i", out_gpio->index, err);
             return err;
         }
 
 #if CONFIG_ZMK_KSCAN_MATRIX_WAIT_BETWEEN_OUTPUTS > 0
-        k_busy_wait(CONFIG_ZMK_KSCAN_MATRIX_WAIT_BETWEEN_OUTPUTS);
+        const struct kscan_gpio *next_gpio = NULL;
+#else
+        // With no wait between outputs, the next output can be set active in the same port
+        // write that sets this one inactive. This halves the bus transactions for outputs on
+        // external GPIO chips such as shift registers.
+        const struct kscan_gpio *next_gpio =
+            i + 1 < config->outputs.len ? &config->outputs.gpios[i + 1] : NULL;
 #endif
-    }
-
-    // Process the new state.
-    bool continue_scan = false;
 
-    for (int r = 0; r < config->rows; r++) {
-        for (int c = 0; c < config->cols; c++) {
-            const int index = state_index_rc(config, r, c);
-            struct zmk_debounce_state *state = &data->matrix_state[index];
+        err = kscan_gpio_pin_advance(out_gpio, next_gpio);
+        if (err < 0) {
+            LOG_ERR("Failed to set output %i inactive: %i", out_gpio->index, err);
+            return err;
+        }
 
-            if (zmk_debounce_get_changed(state)) {
-                const bool pressed = zmk_debounce_is_pressed(state);
+        output_active = err > 0;
 
-                LOG_DBG("Sending event at %i,%i state %s", r, c, pressed ? "on" : "off");
-                data->callback(dev, r, c, pressed);
+        if (next_gpio && !output_active) {
+            err = gpio_pin_set_dt(&next_gpio->spec, 1);
+            if (err) {
+                LOG_ERR("Failed to set output %i active: %i", next_gpio->index, err);
+                return err;
             }
 
-            continue_scan = continue_scan || zmk_debounce_is_active(state);
+            output_active = true;
         }
+
+        settle_start = k_cycle_get_32();
+
+        continue_scan = kscan_matrix_process_output(dev, out_gpio) || continue_scan;
     }
 
     if (continue_scan) {
@@ -359,7 +454,9 @@ static int kscan_matrix_init_input_inst(const struct device *dev, const struct k
 }
 
 static int kscan_matrix_init_inputs(const struct device *dev) {
-    const struct kscan_matrix_data *data = dev->data;
+    struct kscan_matrix_data *data = dev->data;
+
+    data->ports_len = 0;
 
     for (int i = 0; i < data->inputs.len; i++) {
         const struct kscan_gpio *gpio = &data->inputs.gpios[i];
@@ -367,6 +464,13 @@ static int kscan_matrix_init_inputs(const struct device *dev) {
         if (err) {
             return err;
         }
+
+        // Inputs are sorted by port, so each port's pins are contiguous.
+        if (data->ports_len == 0 || data->ports[data->ports_len - 1].port != gpio->spec.port) {
+            data->ports[data->ports_len++] = (struct kscan_matrix_port){.port = gpio->spec.port};
+        }
+
+        data->ports[data->ports_len - 1].mask |= BIT(gpio->spec.pin);
     }
 
     return 0;
@@ -405,6 +509,7 @@ static int kscan_matrix_init_outputs(const struct device *dev) {
 }
 
 static int kscan_matrix_init(const struct device *dev) {
+    const struct kscan_matrix_config *config = dev->config;
     struct kscan_matrix_data *data = dev->data;
 
     data->dev = dev;
@@ -412,6 +517,10 @@ static int kscan_matrix_init(const struct device *dev) {
     // Sort inputs by port so we can read each port just once per scan.
     kscan_gpio_list_sort_by_port(&data->inputs);
 
+    // Sort outputs by port so they can be written together.
+    struct kscan_gpio_list outputs = config->outputs;
+    kscan_gpio_list_sort_by_port(&outputs);
+
     kscan_matrix_init_inputs(dev);
     kscan_matrix_init_outputs(dev);
     kscan_matrix_set_all_outputs(dev, 0);
@@ -441,12 +550,15 @@ static const struct kscan_driver_api kscan_matrix_api = {
                                                                                                    \
     static struct zmk_debounce_state kscan_matrix_state_##n[INST_MATRIX_LEN(n)];                   \
                                                                                                    \
+    static struct kscan_matrix_port kscan_matrix_ports_##n[INST_INPUTS_LEN(n)];                    \
+                                                                                                   \
     COND_INTERRUPTS(                                                                               \
         (static struct kscan_matrix_irq_callback kscan_matrix_irqs_##n[INST_INPUTS_LEN(n)];))      \
                                                                                                    \
     static struct kscan_matrix_data kscan_matrix_data_##n = {                                      \
         .inputs =                                                                                  \
             KSCAN_GPIO_LIST(COND_DIODE_DIR(n, (kscan_matrix_cols_##n), (kscan_matrix_rows_##n))),  \
+        .ports = kscan_matrix_ports_##n,                                                           \
         .matrix_state = kscan_matrix_state_##n,                                                    \
         COND_INTERRUPTS((.irqs = kscan_matrix_irqs_##n, ))};                                       \
                                                                                                    \
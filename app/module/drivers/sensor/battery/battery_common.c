@@ -6,6 +6,7 @@
 
 #include <errno.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/sys/util.h>
 
 #include "battery_common.h"
 
@@ -29,15 +30,62 @@ int battery_channel_get(const struct battery_value *value, enum sensor_channel c
     return 0;
 }
 
+void battery_update_millivolts(struct battery_value *value, uint16_t millivolts) {
+    const uint32_t sample = (uint32_t)millivolts << 4;
+
+    // Exponential moving average. Each sample moves the estimate 1/2^N of the way towards it,
+    // which smooths out ADC noise and load spikes from radio activity.
+    if (value->filtered_mv_16 == 0) {
+        value->filtered_mv_16 = sample;
+    } else {
+        value->filtered_mv_16 = value->filtered_mv_16 -
+                                (value->filtered_mv_16 >> CONFIG_ZMK_BATTERY_FILTER_WEIGHT) +
+                                (sample >> CONFIG_ZMK_BATTERY_FILTER_WEIGHT);
+    }
+
+    value->millivolts = (value->filtered_mv_16 + 8) >> 4;
+    value->state_of_charge = lithium_ion_mv_to_pct(value->millivolts);
+}
+
+struct discharge_point {
+    int16_t millivolts;
+    uint8_t percent;
+};
+
+// Typical discharge curve of a single lithium ion/polymer cell at a light load, from highest to
+// lowest voltage.
+static const struct discharge_point discharge_curve[] = {
+    {4200, 100},
+    {4110, 90},
+    {4020, 80},
+    {3950, 70},
+    {3870, 60},
+    {3840, 50},
+    {3800, 40},
+    {3770, 30},
+    {3730, 20},
+    {3690, 10},
+    {3610, 5},
+    {3400, 0},
+};
+
 uint8_t lithium_ion_mv_to_pct(int16_t bat_mv) {
-    // Simple linear approximation of a battery based off adafruit's discharge graph:
-    // https://learn.adafruit.com/li-ion-and-lipoly-batteries/voltages
+    if (bat_mv >= discharge_curve[0].millivolts) {
+        return discharge_curve[0].percent;
+    }
+
+    for (int i = 1; i < ARRAY_SIZE(discharge_curve); i++) {
+        const struct discharge_point *high = &discharge_curve[i - 1];
+        const struct discharge_point *low = &discharge_curve[i];
 
-    if (bat_mv >= 4200) {
-        return 100;
-    } else if (bat_mv <= 3450) {
-        return 0;
+        if (bat_mv >= low->millivolts) {
+            // Interpolate linearly between the two nearest points.
+            const int range_mv = high->millivolts - low->millivolts;
+            const int range_pct = high->percent - low->percent;
+
+            return low->percent + (bat_mv - low->millivolts) * range_pct / range_mv;
+        }
     }
 
-    return bat_mv * 2 / 15 - 459;
-}
\ No newline at end of file
+    return 0;
+}
@@ -13,9 +13,16 @@ struct battery_value {
     uint16_t adc_raw;
     uint16_t millivolts;
     uint8_t state_of_charge;
+    /** Filtered voltage in 1/16 mV, or 0 before the first sample. */
+    uint32_t filtered_mv_16;
 };
 
 int battery_channel_get(const struct battery_value *value, enum sensor_channel chan,
                         struct sensor_value *val_out);
 
+/**
+ * Add a voltage sample to the filtered estimate and update the voltage and state of charge.
+ */
+void battery_update_millivolts(struct battery_value *value, uint16_t millivolts);
+
 uint8_t lithium_ion_mv_to_pct(int16_t bat_mv);
@@ -55,11 +55,10 @@ static int vddh_sample_fetch(const struct device *dev, enum sensor_channel chan)
         return rc;
     }
 
-    drv_data->value.millivolts = val * VDDHDIV;
-    drv_data->value.state_of_charge = lithium_ion_mv_to_pct(drv_data->value.millivolts);
+    battery_update_millivolts(&drv_data->value, val * VDDHDIV);
 
-    LOG_DBG("ADC raw %d ~ %d mV => %d%%", drv_data->value.adc_raw, drv_data->value.millivolts,
-            drv_data->value.state_of_charge);
+    LOG_DBG("ADC raw %d ~ %d mV => filtered %d mV => %d%%", drv_data->value.adc_raw,
+            val * VDDHDIV, drv_data->value.millivolts, drv_data->value.state_of_charge);
 
     return rc;
 }
@@ -87,7 +86,7 @@ static int vddh_init(const struct device *dev) {
         .channels = BIT(0),
         .buffer = &drv_data->value.adc_raw,
         .buffer_size = sizeof(drv_data->value.adc_raw),
-        .oversampling = 4,
+        .oversampling = CONFIG_ZMK_BATTERY_OVERSAMPLING,
         .calibrate = true,
     };
 
@@ -74,11 +74,10 @@ static int bvd_sample_fetch(const struct device *dev, enum sensor_channel chan)
 
         uint16_t millivolts = val * (uint64_t)drv_cfg->full_ohm / drv_cfg->output_ohm;
         LOG_DBG("ADC raw %d ~ %d mV => %d mV", drv_data->value.adc_raw, val, millivolts);
-        uint8_t percent = lithium_ion_mv_to_pct(millivolts);
-        LOG_DBG("Percent: %d", percent);
 
-        drv_data->value.millivolts = millivolts;
-        drv_data->value.state_of_charge = percent;
+        battery_update_millivolts(&drv_data->value, millivolts);
+        LOG_DBG("Filtered %d mV => %d%%", drv_data->value.millivolts,
+                drv_data->value.state_of_charge);
     } else {
         LOG_DBG("Failed to read ADC: %d", rc);
     }
@@ -134,7 +133,7 @@ static int bvd_init(const struct device *dev) {
         .channels = BIT(0),
         .buffer = &drv_data->value.adc_raw,
         .buffer_size = sizeof(drv_data->value.adc_raw),
-        .oversampling = 4,
+        .oversampling = CONFIG_ZMK_BATTERY_OVERSAMPLING,
         .calibrate = true,
     };
 
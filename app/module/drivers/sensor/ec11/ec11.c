@@ -26,18 +26,13 @@ static int ec11_get_ab_state(const struct device *dev) {
     return (gpio_pin_get_dt(&drv_cfg->a) << 1) | gpio_pin_get_dt(&drv_cfg->b);
 }
 
-static int ec11_sample_fetch(const struct device *dev, enum sensor_channel chan) {
+int ec11_decode_transition(const struct device *dev) {
     struct ec11_data *drv_data = dev->data;
-    const struct ec11_config *drv_cfg = dev->config;
     uint8_t val;
     int8_t delta;
 
-    __ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL || chan == SENSOR_CHAN_ROTATION);
-
     val = ec11_get_ab_state(dev);
 
-    LOG_DBG("prev: %d, new: %d", drv_data->ab_state, val);
-
     switch (val | (drv_data->ab_state << 2)) {
     case 0b0010:
     case 0b0100:
@@ -56,10 +51,32 @@ static int ec11_sample_fetch(const struct device *dev, enum sensor_channel chan)
         break;
     }
 
+    drv_data->ab_state = val;
+
+    if (delta != 0) {
+        atomic_add(&drv_data->pending_pulses, delta);
+    }
+
+    return delta;
+}
+
+static int ec11_sample_fetch(const struct device *dev, enum sensor_channel chan) {
+    struct ec11_data *drv_data = dev->data;
+    const struct ec11_config *drv_cfg = dev->config;
+
+    __ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL || chan == SENSOR_CHAN_ROTATION);
+
+#ifndef CONFIG_EC11_TRIGGER
+    ec11_decode_transition(dev);
+#endif
+
+    // With triggers, the interrupts have already decoded every transition since the last fetch,
+    // so a fetch collects all of them as one delta.
+    int32_t delta = atomic_set(&drv_data->pending_pulses, 0);
+
     LOG_DBG("Delta: %d", delta);
 
     drv_data->pulses += delta;
-    drv_data->ab_state = val;
 
     // TODO: Temporary code for backwards compatibility to support
     // the sensor channel rotation reporting *ticks* instead of delta of degrees.
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <zephyr/device.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/sys/util.h>
 
@@ -20,9 +21,12 @@ struct ec11_config {
 
 struct ec11_data {
     uint8_t ab_state;
-    int8_t pulses;
-    int8_t ticks;
-    int8_t delta;
+    int32_t pulses;
+    int32_t ticks;
+    int32_t delta;
+
+    /* Transitions decoded since the last sample fetch. Added to from the GPIO interrupts. */
+    atomic_t pending_pulses;
 
 #ifdef CONFIG_EC11_TRIGGER
     struct gpio_callback a_gpio_cb;
@@ -37,12 +41,20 @@ struct ec11_data {
     struct k_sem gpio_sem;
     struct k_thread thread;
 #elif defined(CONFIG_EC11_TRIGGER_GLOBAL_THREAD)
-    struct k_work work;
+    struct k_work_delayable work;
 #endif
 
 #endif /* CONFIG_EC11_TRIGGER */
 };
 
+/**
+ * Decode the transition from the previous A/B state to the current one, and add it to the
+ * pending pulses. Safe to call from an ISR.
+ *
+ * @return The decoded delta: 1, -1, or 0 if the state is unchanged or the transition is invalid.
+ */
+int ec11_decode_transition(const struct device *dev);
+
 #ifdef CONFIG_EC11_TRIGGER
 
 int ec11_trigger_set(const struct device *dev, const struct sensor_trigger *trig,
@@ -29,46 +29,50 @@ static inline void setup_int(const struct device *dev, bool enable) {
     }
 
     if (gpio_pin_interrupt_configure_dt(&cfg->b, enable ? GPIO_INT_EDGE_BOTH : GPIO_INT_DISABLE)) {
-        LOG_WRN("Unable to set A pin GPIO interrupt");
+        LOG_WRN("Unable to set B pin GPIO interrupt");
     }
 }
 
-static void ec11_a_gpio_callback(const struct device *dev, struct gpio_callback *cb,
-                                 uint32_t pins) {
-    struct ec11_data *drv_data = CONTAINER_OF(cb, struct ec11_data, a_gpio_cb);
-
-    LOG_DBG("");
-
-    setup_int(drv_data->dev, false);
+/*
+ * Transitions are decoded right in the interrupt, and interrupts stay enabled while the report
+ * is pending, so no steps are lost while the handler runs. Every transition which arrives before
+ * the handler runs is reported in the same batch.
+ */
+static void ec11_gpio_callback_common(struct ec11_data *drv_data) {
+    if (ec11_decode_transition(drv_data->dev) == 0) {
+        return;
+    }
 
 #if defined(CONFIG_EC11_TRIGGER_OWN_THREAD)
     k_sem_give(&drv_data->gpio_sem);
 #elif defined(CONFIG_EC11_TRIGGER_GLOBAL_THREAD)
-    k_work_submit(&drv_data->work);
+    k_work_schedule(&drv_data->work, K_MSEC(CONFIG_EC11_REPORT_INTERVAL_MS));
 #endif
 }
 
-static void ec11_b_gpio_callback(const struct device *dev, struct gpio_callback *cb,
+static void ec11_a_gpio_callback(const struct device *dev, struct gpio_callback *cb,
                                  uint32_t pins) {
-    struct ec11_data *drv_data = CONTAINER_OF(cb, struct ec11_data, b_gpio_cb);
+    struct ec11_data *drv_data = CONTAINER_OF(cb, struct ec11_data, a_gpio_cb);
 
-    LOG_DBG("");
+    ec11_gpio_callback_common(drv_data);
+}
 
-    setup_int(drv_data->dev, false);
+static void ec11_b_gpio_callback(const struct device *dev, struct gpio_callback *cb,
+                                 uint32_t pins) {
+    struct ec11_data *drv_data = CONTAINER_OF(cb, struct ec11_data, b_gpio_cb);
 
-#if defined(CONFIG_EC11_TRIGGER_OWN_THREAD)
-    k_sem_give(&drv_data->gpio_sem);
-#elif defined(CONFIG_EC11_TRIGGER_GLOBAL_THREAD)
-    k_work_submit(&drv_data->work);
-#endif
+    ec11_gpio_callback_common(drv_data);
 }
 
 static void ec11_thread_cb(const struct device *dev) {
     struct ec11_data *drv_data = dev->data;
 
-    drv_data->handler(dev, drv_data->trigger);
+    // A previous report may already have collected these transitions.
+    if (atomic_get(&drv_data->pending_pulses) == 0) {
+        return;
+    }
 
-    setup_int(dev, true);
+    drv_data->handler(dev, drv_data->trigger);
 }
 
 #ifdef CONFIG_EC11_TRIGGER_OWN_THREAD
@@ -80,6 +84,9 @@ static void ec11_thread(int dev_ptr, int unused) {
 
     while (1) {
         k_sem_take(&drv_data->gpio_sem, K_FOREVER);
+#if CONFIG_EC11_REPORT_INTERVAL_MS > 0
+        k_msleep(CONFIG_EC11_REPORT_INTERVAL_MS);
+#endif
         ec11_thread_cb(dev);
     }
 }
@@ -87,7 +94,8 @@ static void ec11_thread(int dev_ptr, int unused) {
 
 #ifdef CONFIG_EC11_TRIGGER_GLOBAL_THREAD
 static void ec11_work_cb(struct k_work *work) {
-    struct ec11_data *drv_data = CONTAINER_OF(work, struct ec11_data, work);
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct ec11_data *drv_data = CONTAINER_OF(dwork, struct ec11_data, work);
 
     LOG_DBG("");
 
@@ -133,13 +141,13 @@ int ec11_init_interrupt(const struct device *dev) {
     }
 
 #if defined(CONFIG_EC11_TRIGGER_OWN_THREAD)
-    k_sem_init(&drv_data->gpio_sem, 0, UINT_MAX);
+    k_sem_init(&drv_data->gpio_sem, 0, 1);
 
     k_thread_create(&drv_data->thread, drv_data->thread_stack, CONFIG_EC11_THREAD_STACK_SIZE,
                     (k_thread_entry_t)ec11_thread, dev, 0, NULL,
                     K_PRIO_COOP(CONFIG_EC11_THREAD_PRIORITY), 0, K_NO_WAIT);
 #elif defined(CONFIG_EC11_TRIGGER_GLOBAL_THREAD)
-    k_work_init(&drv_data->work, ec11_work_cb);
+    k_work_init_delayable(&drv_data->work, ec11_work_cb);
 #endif
 
     return 0;
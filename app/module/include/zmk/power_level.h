@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+
+/**
+ * Keyboard-wide performance levels, from most to least responsive. Drivers and subsystems with
+ * periodic work scale their periods by the current level, so battery life and latency can be
+ * traded off in one place.
+ */
+enum zmk_power_level {
+    ZMK_POWER_LEVEL_ACTIVE,
+    ZMK_POWER_LEVEL_IDLE,
+    ZMK_POWER_LEVEL_DEEP_IDLE,
+};
+
+#define ZMK_POWER_LEVEL_COUNT (ZMK_POWER_LEVEL_DEEP_IDLE + 1)
+
+#if IS_ENABLED(CONFIG_ZMK_POWER_LEVEL)
+
+enum zmk_power_level zmk_power_level_get(void);
+void zmk_power_level_set(enum zmk_power_level level);
+
+/**
+ * Get how long a periodic task should wait between runs at the current power level.
+ *
+ * @param period_ms The period to use at ZMK_POWER_LEVEL_ACTIVE.
+ */
+uint32_t zmk_power_level_scale_ms(uint32_t period_ms);
+
+/**
+ * Scale a period, in any unit, by the factor configured for a given power level.
+ *
+ * @param level The power level whose factor to apply.
+ * @param period The period to use at ZMK_POWER_LEVEL_ACTIVE.
+ */
+uint32_t zmk_power_level_scale(enum zmk_power_level level, uint32_t period);
+
+#else
+
+static inline enum zmk_power_level zmk_power_level_get(void) { return ZMK_POWER_LEVEL_ACTIVE; }
+
+static inline uint32_t zmk_power_level_scale_ms(uint32_t period_ms) { return period_ms; }
+
+static inline uint32_t zmk_power_level_scale(enum zmk_power_level level, uint32_t period) {
+    return period;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_POWER_LEVEL) */
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/sys/atomic.h>
+
+#include <zmk/power_level.h>
+
+static const uint8_t power_level_scales[ZMK_POWER_LEVEL_COUNT] = {
+    [ZMK_POWER_LEVEL_ACTIVE] = 1,
+    [ZMK_POWER_LEVEL_IDLE] = CONFIG_ZMK_POWER_LEVEL_IDLE_SCALE,
+    [ZMK_POWER_LEVEL_DEEP_IDLE] = CONFIG_ZMK_POWER_LEVEL_DEEP_IDLE_SCALE,
+};
+
+static atomic_t power_level = ATOMIC_INIT(ZMK_POWER_LEVEL_ACTIVE);
+
+enum zmk_power_level zmk_power_level_get(void) { return atomic_get(&power_level); }
+
+void zmk_power_level_set(enum zmk_power_level level) { atomic_set(&power_level, level); }
+
+uint32_t zmk_power_level_scale(enum zmk_power_level level, uint32_t period) {
+    return period * power_level_scales[level];
+}
+
+uint32_t zmk_power_level_scale_ms(uint32_t period_ms) {
+    return zmk_power_level_scale(zmk_power_level_get(), period_ms);
+}
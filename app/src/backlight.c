@@ -15,6 +15,7 @@
 
 #include <zmk/activity.h>
 #include <zmk/backlight.h>
+#include <zmk/settings.h>
 #include <zmk/usb.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/activity_state_changed.h>
@@ -71,11 +72,11 @@ static int backlight_settings_load_cb(const char *name, size_t len, settings_rea
     return -ENOENT;
 }
 
-static void backlight_save_work_handler(struct k_work *work) {
-    settings_save_one("backlight/state", &state, sizeof(state));
+static void backlight_save_state(void) {
+    zmk_settings_save_one("backlight/state", &state, sizeof(state));
 }
 
-static struct k_work_delayable backlight_save_work;
+ZMK_SETTINGS_SAVER_DEFINE(backlight_saver, backlight_save_state);
 #endif
 
 static int zmk_backlight_init(const struct device *_arg) {
@@ -90,7 +91,6 @@ static int zmk_backlight_init(const struct device *_arg) {
     if (rc != 0) {
         LOG_ERR("Failed to load backlight settings: %d", rc);
     }
-    k_work_init_delayable(&backlight_save_work, backlight_save_work_handler);
 #endif
 #if IS_ENABLED(CONFIG_ZMK_BACKLIGHT_AUTO_OFF_USB)
     state.on = zmk_usb_is_powered();
@@ -105,8 +105,7 @@ static int zmk_backlight_update_and_save(void) {
     }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-    int ret = k_work_reschedule(&backlight_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
-    return MIN(ret, 0);
+    return zmk_settings_save_request(&backlight_saver);
 #else
     return 0;
 #endif
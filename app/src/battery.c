@@ -4,6 +4,8 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <stdlib.h>
+
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/init.h>
@@ -12,6 +14,7 @@
 #include <zephyr/bluetooth/services/bas.h>
 
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -23,6 +26,12 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/workqueue.h>
 
 static uint8_t last_state_of_charge = 0;
+static bool state_of_charge_reported = false;
+
+// State of charge from the previous sample, used to detect when the estimate is stable.
+static uint8_t last_sample_state_of_charge = 0;
+// Seconds until the next sample.
+static uint32_t sample_interval = CONFIG_ZMK_BATTERY_REPORT_INTERVAL;
 
 uint8_t zmk_battery_state_of_charge(void) { return last_state_of_charge; }
 
@@ -34,6 +43,27 @@ static const struct device *const battery = DEVICE_DT_GET(DT_CHOSEN(zmk_battery)
 static const struct device *battery;
 #endif
 
+/**
+ * Only report changes of at least CONFIG_ZMK_BATTERY_REPORT_HYSTERESIS percent, so noise near a
+ * boundary doesn't cause a stream of events and BLE notifications. Reaching empty or full is
+ * always reported.
+ */
+static bool zmk_battery_should_report(const uint8_t state_of_charge) {
+    if (!state_of_charge_reported) {
+        return true;
+    }
+
+    if (state_of_charge == last_state_of_charge) {
+        return false;
+    }
+
+    if (state_of_charge == 0 || state_of_charge == 100) {
+        return true;
+    }
+
+    return abs(state_of_charge - last_state_of_charge) >= CONFIG_ZMK_BATTERY_REPORT_HYSTERESIS;
+}
+
 static int zmk_battery_update(const struct device *battery) {
     struct sensor_value state_of_charge;
 
@@ -51,8 +81,19 @@ static int zmk_battery_update(const struct device *battery) {
         return rc;
     }
 
-    if (last_state_of_charge != state_of_charge.val1) {
+    // Sample less often while the estimate is stable, and return to the normal interval as soon
+    // as it moves.
+    if (state_of_charge.val1 == last_sample_state_of_charge) {
+        sample_interval = MIN(sample_interval * 2, CONFIG_ZMK_BATTERY_REPORT_INTERVAL_MAX);
+    } else {
+        sample_interval = CONFIG_ZMK_BATTERY_REPORT_INTERVAL;
+    }
+
+    last_sample_state_of_charge = state_of_charge.val1;
+
+    if (zmk_battery_should_report(state_of_charge.val1)) {
         last_state_of_charge = state_of_charge.val1;
+        state_of_charge_reported = true;
 #if IS_ENABLED(CONFIG_BT_BAS)
         LOG_DBG("Setting BAS GATT battery level to %d.", last_state_of_charge);
 
@@ -70,25 +111,25 @@ static int zmk_battery_update(const struct device *battery) {
     return rc;
 }
 
+static void zmk_battery_work(struct k_work *work);
+
+K_WORK_DELAYABLE_DEFINE(battery_work, zmk_battery_work);
+
 static void zmk_battery_work(struct k_work *work) {
     int rc = zmk_battery_update(battery);
 
     if (rc != 0) {
         LOG_DBG("Failed to update battery value: %d.", rc);
     }
-}
 
-K_WORK_DEFINE(battery_work, zmk_battery_work);
-
-static void zmk_battery_timer(struct k_timer *timer) {
-    k_work_submit_to_queue(zmk_workqueue_lowprio_work_q(), &battery_work);
+    k_work_schedule_for_queue(zmk_workqueue_lowprio_work_q(), &battery_work,
+                              K_SECONDS(sample_interval));
 }
 
-K_TIMER_DEFINE(battery_timer, zmk_battery_timer, NULL);
-
 static void zmk_battery_start_reporting() {
     if (device_is_ready(battery)) {
-        k_timer_start(&battery_timer, K_NO_WAIT, K_SECONDS(CONFIG_ZMK_BATTERY_REPORT_INTERVAL));
+        sample_interval = CONFIG_ZMK_BATTERY_REPORT_INTERVAL;
+        k_work_reschedule_for_queue(zmk_workqueue_lowprio_work_q(), &battery_work, K_NO_WAIT);
     }
 }
 
@@ -121,7 +162,7 @@ static int battery_event_listener(const zmk_event_t *eh) {
             return 0;
         case ZMK_ACTIVITY_IDLE:
         case ZMK_ACTIVITY_SLEEP:
-            k_timer_stop(&battery_timer);
+            k_work_cancel_delayable(&battery_work);
             return 0;
         default:
             break;
@@ -20,6 +20,10 @@
 #include <zmk/behavior.h>
 #include <zmk/keymap.h>
 
+#if IS_ENABLED(CONFIG_ZMK_TRACE)
+#include <zmk/trace.h>
+#endif
+
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
@@ -437,6 +441,24 @@ static void decide_positional_hold(struct active_hold_tap *hold_tap) {
     hold_tap->status = STATUS_TAP;
 }
 
+#if IS_ENABLED(CONFIG_ZMK_TRACE)
+static void trace_decision(struct active_hold_tap *hold_tap,
+                           enum zmk_trace_hold_tap_decision decision) {
+    zmk_trace_record(ZMK_TRACE_HOLD_TAP, hold_tap->position, 0, decision, k_uptime_get());
+}
+
+static enum zmk_trace_hold_tap_decision status_trace_decision(enum status status) {
+    switch (status) {
+    case STATUS_HOLD_INTERRUPT:
+        return ZMK_TRACE_HOLD_TAP_HOLD_INTERRUPT;
+    case STATUS_HOLD_TIMER:
+        return ZMK_TRACE_HOLD_TAP_HOLD_TIMER;
+    default:
+        return ZMK_TRACE_HOLD_TAP_TAP;
+    }
+}
+#endif
+
 static void decide_hold_tap(struct active_hold_tap *hold_tap,
                             enum decision_moment decision_moment) {
     if (hold_tap->status != STATUS_UNDECIDED) {
@@ -475,6 +497,9 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
     LOG_DBG("%d decided %s (%s decision moment %s)", hold_tap->position,
             status_str(hold_tap->status), flavor_str(hold_tap->config->flavor),
             decision_moment_str(decision_moment));
+#if IS_ENABLED(CONFIG_ZMK_TRACE)
+    trace_decision(hold_tap, status_trace_decision(hold_tap->status));
+#endif
     undecided_hold_tap = NULL;
     press_binding(hold_tap);
     release_captured_events();
@@ -487,6 +512,9 @@ static void decide_retro_tap(struct active_hold_tap *hold_tap) {
     if (hold_tap->status == STATUS_HOLD_TIMER) {
         release_binding(hold_tap);
         LOG_DBG("%d retro tap", hold_tap->position);
+#if IS_ENABLED(CONFIG_ZMK_TRACE)
+        trace_decision(hold_tap, ZMK_TRACE_HOLD_TAP_RETRO_TAP);
+#endif
         hold_tap->status = STATUS_TAP;
         press_binding(hold_tap);
         return;
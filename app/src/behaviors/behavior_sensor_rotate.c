@@ -33,6 +33,8 @@ static int behavior_sensor_rotate_init(const struct device *dev) { return 0; };
         .ccw_binding = _TRANSFORM_ENTRY(1, n),                                                     \
         .tap_ms = DT_INST_PROP_OR(n, tap_ms, 5),                                                   \
         .override_params = false,                                                                  \
+        .acceleration_speed = DT_INST_PROP(n, acceleration_speed),                                 \
+        .acceleration_max = DT_INST_PROP(n, acceleration_max),                                     \
     };                                                                                             \
     static struct behavior_sensor_rotate_data behavior_sensor_rotate_data_##n = {};                \
     BEHAVIOR_DT_INST_DEFINE(n, behavior_sensor_rotate_init, NULL,                                  \
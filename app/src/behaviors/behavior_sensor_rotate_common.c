@@ -3,6 +3,7 @@
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
+#include <stdlib.h>
 
 #include <zmk/behavior_queue.h>
 #include <zmk/virtual_key_position.h>
@@ -11,11 +12,37 @@
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
+/**
+ * Scale the triggers by how fast the sensor is turning, measured from the time since the
+ * previous triggers. Slow turns keep one trigger per step, and each multiple of the configured
+ * speed adds another, up to the configured maximum.
+ */
+static int sensor_rotate_accelerate(const struct behavior_sensor_rotate_config *cfg,
+                                    struct behavior_sensor_rotate_data *data, int sensor_index,
+                                    uint8_t layer, int triggers, int64_t timestamp) {
+    if (cfg->acceleration_speed == 0 || triggers == 0) {
+        return triggers;
+    }
+
+    int64_t elapsed = timestamp - data->last_trigger_time[sensor_index][layer];
+    data->last_trigger_time[sensor_index][layer] = timestamp;
+
+    const int64_t speed = (int64_t)abs(triggers) * MSEC_PER_SEC / MAX(elapsed, 1);
+    // An acceleration-max below 1 would drop every trigger, so treat it as no acceleration.
+    const int multiplier =
+        CLAMP(speed / cfg->acceleration_speed, 1, MAX(cfg->acceleration_max, 1));
+
+    LOG_DBG("speed: %lld triggers/s, multiplier: %d", speed, multiplier);
+
+    return triggers * multiplier;
+}
+
 int zmk_behavior_sensor_rotate_common_accept_data(
     struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event,
     const struct zmk_sensor_config *sensor_config, size_t channel_data_size,
     const struct zmk_sensor_channel_data *channel_data) {
     const struct device *dev = zmk_behavior_get_binding(binding->behavior_dev);
+    const struct behavior_sensor_rotate_config *cfg = dev->config;
     struct behavior_sensor_rotate_data *data = dev->data;
 
     const struct sensor_value value = channel_data[0].value;
@@ -45,6 +72,9 @@ int zmk_behavior_sensor_rotate_common_accept_data(
         data->remainder[sensor_index][event.layer] = remainder;
     }
 
+    triggers =
+        sensor_rotate_accelerate(cfg, data, sensor_index, event.layer, triggers, event.timestamp);
+
     LOG_DBG(
         "val1: %d, val2: %d, remainder: %d/%d triggers: %d inc keycode 0x%02X dec keycode 0x%02X",
         value.val1, value.val2, data->remainder[sensor_index][event.layer].val1,
@@ -14,11 +14,15 @@ struct behavior_sensor_rotate_config {
     struct zmk_behavior_binding ccw_binding;
     int tap_ms;
     bool override_params;
+    // Triggers per second for each step of acceleration, or 0 to disable acceleration.
+    uint16_t acceleration_speed;
+    uint8_t acceleration_max;
 };
 
 struct behavior_sensor_rotate_data {
     struct sensor_value remainder[ZMK_KEYMAP_SENSORS_LEN][ZMK_KEYMAP_LAYERS_LEN];
     int triggers[ZMK_KEYMAP_SENSORS_LEN][ZMK_KEYMAP_LAYERS_LEN];
+    int64_t last_trigger_time[ZMK_KEYMAP_SENSORS_LEN][ZMK_KEYMAP_LAYERS_LEN];
 };
 
 int zmk_behavior_sensor_rotate_common_accept_data(
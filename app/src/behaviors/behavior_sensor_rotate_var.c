@@ -24,6 +24,8 @@ static int behavior_sensor_rotate_var_init(const struct device *dev) { return 0;
         .ccw_binding = {.behavior_dev = DEVICE_DT_NAME(DT_INST_PHANDLE_BY_IDX(n, bindings, 1))},   \
         .tap_ms = DT_INST_PROP(n, tap_ms),                                                         \
         .override_params = true,                                                                   \
+        .acceleration_speed = DT_INST_PROP(n, acceleration_speed),                                 \
+        .acceleration_max = DT_INST_PROP(n, acceleration_max),                                     \
     };                                                                                             \
     static struct behavior_sensor_rotate_data behavior_sensor_rotate_var_data_##n = {};            \
     BEHAVIOR_DT_INST_DEFINE(                                                                       \
@@ -33,10 +33,16 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/ble.h>
 #include <zmk/keys.h>
+#include <zmk/settings.h>
 #include <zmk/split/bluetooth/uuid.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/ble_active_profile_changed.h>
 
+#if IS_ENABLED(CONFIG_ZMK_POWER_GOVERNOR)
+#include <zmk/events/power_level_changed.h>
+#include <zmk/power_level.h>
+#endif /* IS_ENABLED(CONFIG_ZMK_POWER_GOVERNOR) */
+
 #if IS_ENABLED(CONFIG_ZMK_BLE_PASSKEY_ENTRY)
 #include <zmk/events/keycode_state_changed.h>
 
@@ -107,7 +113,7 @@ void set_profile_address(uint8_t index, const bt_addr_le_t *addr) {
     sprintf(setting_name, "ble/profiles/%d", index);
     LOG_DBG("Setting profile addr for %s to %s", setting_name, addr_str);
 #if IS_ENABLED(CONFIG_SETTINGS)
-    settings_save_one(setting_name, &profiles[index], sizeof(struct zmk_ble_profile));
+    zmk_settings_save_one(setting_name, &profiles[index], sizeof(struct zmk_ble_profile));
 #endif
     k_work_submit(&raise_profile_changed_event_work);
 }
@@ -249,16 +255,16 @@ int zmk_ble_profile_index(const bt_addr_le_t *addr) {
 }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-static void ble_save_profile_work(struct k_work *work) {
-    settings_save_one("ble/active_profile", &active_profile, sizeof(active_profile));
+static void ble_save_active_profile(void) {
+    zmk_settings_save_one("ble/active_profile", &active_profile, sizeof(active_profile));
 }
 
-static struct k_work_delayable ble_save_work;
+ZMK_SETTINGS_SAVER_DEFINE(ble_active_profile_saver, ble_save_active_profile);
 #endif
 
 static int ble_save_profile(void) {
 #if IS_ENABLED(CONFIG_SETTINGS)
-    return k_work_reschedule(&ble_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+    return zmk_settings_save_request(&ble_active_profile_saver);
 #else
     return 0;
 #endif
@@ -346,7 +352,7 @@ int zmk_ble_put_peripheral_addr(const bt_addr_le_t *addr) {
 
             char setting_name[32];
             sprintf(setting_name, "ble/peripheral_addresses/%d", i);
-            settings_save_one(setting_name, addr, sizeof(bt_addr_le_t));
+            zmk_settings_save_one(setting_name, addr, sizeof(bt_addr_le_t));
 
             return i;
         }
@@ -646,8 +652,6 @@ static int zmk_ble_init(const struct device *_arg) {
         return err;
     }
 
-    k_work_init_delayable(&ble_save_work, ble_save_profile_work);
-
     settings_load_subtree("ble");
     settings_load_subtree("bt");
 
@@ -775,4 +779,56 @@ ZMK_LISTENER(zmk_ble, zmk_ble_listener);
 ZMK_SUBSCRIPTION(zmk_ble, zmk_keycode_state_changed);
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE_PASSKEY_ENTRY) */
 
+#if IS_ENABLED(CONFIG_ZMK_POWER_GOVERNOR)
+
+// Largest connection interval, in 1.25 ms units, for which the supervision timeout (in 10 ms
+// units) still covers two full periods of peripheral latency, as the spec requires.
+#define ZMK_BLE_MAX_CONN_INTERVAL                                                                  \
+    (CONFIG_BT_PERIPHERAL_PREF_TIMEOUT * 4 / (CONFIG_BT_PERIPHERAL_PREF_LATENCY + 1) - 1)
+
+static enum zmk_power_level conn_param_level = ZMK_POWER_LEVEL_ACTIVE;
+
+static int zmk_ble_power_level_listener(const zmk_event_t *eh) {
+    const struct zmk_power_level_changed *ev = as_zmk_power_level_changed(eh);
+    if (ev == NULL) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    // Renegotiating costs radio time and some hosts reject frequent requests, so only switch
+    // between the normal and the deep idle interval, not on every active/idle transition.
+    enum zmk_power_level level =
+        ev->level == ZMK_POWER_LEVEL_DEEP_IDLE ? ZMK_POWER_LEVEL_DEEP_IDLE : ZMK_POWER_LEVEL_ACTIVE;
+    if (level == conn_param_level) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+    conn_param_level = level;
+
+    struct bt_conn *conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, zmk_ble_active_profile_addr());
+    if (conn == NULL) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    // Intervals are in 1.25 ms units, so scale them directly rather than as milliseconds.
+    uint16_t max_int = MIN(zmk_power_level_scale(level, CONFIG_BT_PERIPHERAL_PREF_MAX_INT),
+                           ZMK_BLE_MAX_CONN_INTERVAL);
+    uint16_t min_int =
+        MIN(zmk_power_level_scale(level, CONFIG_BT_PERIPHERAL_PREF_MIN_INT), max_int);
+
+    int err = bt_conn_le_param_update(
+        conn, BT_LE_CONN_PARAM(min_int, max_int, CONFIG_BT_PERIPHERAL_PREF_LATENCY,
+                               CONFIG_BT_PERIPHERAL_PREF_TIMEOUT));
+    if (err) {
+        LOG_WRN("Failed to update connection parameters (err %d)", err);
+    }
+
+    bt_conn_unref(conn);
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(zmk_ble_power_level, zmk_ble_power_level_listener);
+ZMK_SUBSCRIPTION(zmk_ble_power_level, zmk_power_level_changed);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_POWER_GOVERNOR) */
+
 SYS_INIT(zmk_ble_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
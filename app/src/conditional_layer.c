@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
 
 #include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
@@ -20,25 +21,35 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
-static K_SEM_DEFINE(conditional_layer_sem, 1, 1);
-
 // Conditional layer configuration that activates the specified then-layer when all if-layers are
 // active. With two if-layers, this is referred to as "tri-layer", and is commonly used to activate
 // a third "adjust" layer if and only if the "lower" and "raise" layers are both active.
 struct conditional_layer_cfg {
-    // A bitmask of each layer that must be pressed for this conditional layer config to activate.
-    zmk_keymap_layers_state_t if_layers_state_mask;
+    // Each layer that must be pressed for this conditional layer config to activate.
+    const uint8_t *if_layers;
+    size_t if_layers_len;
 
     // The layer number that should be active while all layers in the if-layers mask are active.
     int8_t then_layer;
 };
 
-#define IF_LAYER_BIT(node_id, prop, idx) BIT(DT_PROP_BY_IDX(node_id, prop, idx)) |
+#define IF_LAYERS_NAME(n) _CONCAT(conditional_layer_if_layers_, DT_DEP_ORD(n))
+
+#define IF_LAYERS_DECL(n) static const uint8_t IF_LAYERS_NAME(n)[] = DT_PROP(n, if_layers);
+
+DT_INST_FOREACH_CHILD(0, IF_LAYERS_DECL)
+
+#define THEN_LAYER_CHECK(n)                                                                        \
+    BUILD_ASSERT(DT_PROP(n, then_layer) < ZMK_KEYMAP_LAYERS_LEN,                                   \
+                 "Conditional layer then-layer is not a layer in the keymap");
+
+DT_INST_FOREACH_CHILD(0, THEN_LAYER_CHECK)
 
 // Evaluates to conditional_layer_cfg struct initializer.
 #define CONDITIONAL_LAYER_DECL(n)                                                                  \
     {                                                                                              \
-        .if_layers_state_mask = DT_FOREACH_PROP_ELEM(n, if_layers, IF_LAYER_BIT) 0,                \
+        .if_layers = IF_LAYERS_NAME(n),                                                            \
+        .if_layers_len = DT_PROP_LEN(n, if_layers),                                                \
         .then_layer = DT_PROP(n, then_layer),                                                      \
     },
 
@@ -46,79 +57,177 @@ struct conditional_layer_cfg {
 static const struct conditional_layer_cfg CONDITIONAL_LAYER_CFGS[] = {
     DT_INST_FOREACH_CHILD(0, CONDITIONAL_LAYER_DECL)};
 
-static const int32_t NUM_CONDITIONAL_LAYER_CFGS =
-    sizeof(CONDITIONAL_LAYER_CFGS) / sizeof(*CONDITIONAL_LAYER_CFGS);
+#define NUM_CONDITIONAL_LAYER_CFGS ARRAY_SIZE(CONDITIONAL_LAYER_CFGS)
+
+// The evaluation table, built from CONDITIONAL_LAYER_CFGS at init. Each entry holds the if-layers
+// of a config as a bitmask, and entries are ordered so that a config whose then-layer is one of
+// another config's if-layers comes first. That way a single pass over the table settles every
+// chained then-layer.
+struct conditional_layer_entry {
+    zmk_keymap_layers_state_t if_layers_state_mask;
+    int8_t then_layer;
+};
+
+static struct conditional_layer_entry conditional_layer_table[NUM_CONDITIONAL_LAYER_CFGS];
+
+// Every layer that is the then-layer of at least one config.
+static zmk_keymap_layers_state_t then_layers_state_mask;
+
+// Every layer that is an if-layer or then-layer of at least one config. Layer changes outside of
+// these can't affect any config.
+static zmk_keymap_layers_state_t conditional_layers_state_mask;
+
+// Set if the configs depend on each other in a loop, which has no valid evaluation order. The
+// table is then evaluated repeatedly until the result stops changing instead.
+static bool conditional_layer_table_has_cycle;
 
-static void conditional_layer_activate(int8_t layer) {
-    // This may trigger another event that could, in turn, activate additional then-layers. However,
-    // the process will eventually terminate (at worst, when every layer is active).
-    if (!zmk_keymap_layer_active(layer)) {
-        LOG_DBG("layer %d", layer);
-        zmk_keymap_layer_activate(layer);
+// Returns the layer state with every then-layer active if and only if all if-layers of one of its
+// configs are active in that same resulting state.
+static zmk_keymap_layers_state_t
+conditional_layer_evaluate(const zmk_keymap_layers_state_t *layer_state,
+                           const zmk_keymap_layers_state_t *if_state) {
+    zmk_keymap_layers_state_t result = *layer_state;
+
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        result.words[i] &= ~then_layers_state_mask.words[i];
     }
+
+    for (int i = 0; i < NUM_CONDITIONAL_LAYER_CFGS; i++) {
+        const struct conditional_layer_entry *entry = &conditional_layer_table[i];
+
+        // Chained configs test the result so far, which already holds their if-layers' final
+        // state thanks to the table order. Looping configs test the previous pass instead.
+        const zmk_keymap_layers_state_t *state_to_test = if_state ? if_state : &result;
+
+        if (zmk_keymap_layers_state_contains(state_to_test, &entry->if_layers_state_mask)) {
+            zmk_keymap_layers_state_write(&result, entry->then_layer, true);
+        }
+    }
+
+    return result;
 }
 
-static void conditional_layer_deactivate(int8_t layer) {
-    // This may deactivate a then-layer that's already active via another mechanism (e.g., a
-    // momentary layer behavior). However, the same problem arises when multiple keys with the same
-    // &mo binding are held and then one is released, so it's probably not an issue in practice.
-    if (zmk_keymap_layer_active(layer)) {
-        LOG_DBG("layer %d", layer);
-        zmk_keymap_layer_deactivate(layer);
+static zmk_keymap_layers_state_t
+conditional_layer_closure(const zmk_keymap_layers_state_t *layer_state) {
+    if (!conditional_layer_table_has_cycle) {
+        return conditional_layer_evaluate(layer_state, NULL);
+    }
+
+    zmk_keymap_layers_state_t result = *layer_state;
+
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        result.words[i] &= ~then_layers_state_mask.words[i];
+    }
+
+    // Each pass can only turn on then-layers of configs further along a chain, so this settles
+    // within one pass per config unless the configs flip each other back and forth.
+    for (int pass = 0; pass <= NUM_CONDITIONAL_LAYER_CFGS; pass++) {
+        zmk_keymap_layers_state_t next = conditional_layer_evaluate(layer_state, &result);
+
+        if (zmk_keymap_layers_state_equal(&next, &result)) {
+            break;
+        }
+
+        result = next;
     }
+
+    return result;
 }
 
 static int layer_state_changed_listener(const zmk_event_t *ev) {
-    static bool conditional_layer_updates_needed;
+    const struct zmk_layer_state_changed *data = as_zmk_layer_state_changed(ev);
+    zmk_keymap_layers_state_t changed =
+        zmk_keymap_layers_state_diff(&data->old_state, &data->new_state);
 
-    conditional_layer_updates_needed = true;
+    if (!zmk_keymap_layers_state_intersects(&changed, &conditional_layers_state_mask)) {
+        return 0;
+    }
+
+    zmk_keymap_layers_state_t layer_state = zmk_keymap_layer_state();
+    zmk_keymap_layers_state_t new_layer_state = conditional_layer_closure(&layer_state);
 
-    // Semaphore ensures we don't re-enter the loop in the middle of doing update, and
-    // ensures that "waterfalling layer updates" are all processed to trigger subsequent
-    // nested conditional layers properly.
-    if (k_sem_take(&conditional_layer_sem, K_NO_WAIT) < 0) {
+    if (zmk_keymap_layers_state_equal(&layer_state, &new_layer_state)) {
         return 0;
     }
 
-    while (conditional_layer_updates_needed) {
-        int8_t max_then_layer = -1;
-        uint32_t then_layers = 0;
-        uint32_t then_layer_state = 0;
-
-        conditional_layer_updates_needed = false;
-
-        // On layer state changes, examines each conditional layer config to determine if then-layer
-        // in the config should activate based on the currently active set of if-layers.
-        for (int i = 0; i < NUM_CONDITIONAL_LAYER_CFGS; i++) {
-            const struct conditional_layer_cfg *cfg = CONDITIONAL_LAYER_CFGS + i;
-            zmk_keymap_layers_state_t mask = cfg->if_layers_state_mask;
-            then_layers |= BIT(cfg->then_layer);
-            max_then_layer = MAX(max_then_layer, cfg->then_layer);
-
-            // Activate then-layer if and only if all if-layers are already active. Note that we
-            // reevaluate the current layer state for each config since activation of one layer can
-            // also trigger activation of another.
-            if ((zmk_keymap_layer_state() & mask) == mask) {
-                then_layer_state |= BIT(cfg->then_layer);
+    // Applying the whole result at once raises a single event. The closure of the new state is
+    // the new state itself, so handling that event changes nothing further.
+    zmk_keymap_layer_state_set(new_layer_state);
+
+    return 0;
+}
+
+static bool conditional_layer_depends_on(const struct conditional_layer_entry *entry,
+                                         const struct conditional_layer_entry *dependency) {
+    return entry != dependency &&
+           zmk_keymap_layers_state_test(&entry->if_layers_state_mask, dependency->then_layer);
+}
+
+static int conditional_layer_init(const struct device *_arg) {
+    struct conditional_layer_entry entries[NUM_CONDITIONAL_LAYER_CFGS] = {0};
+    bool placed[NUM_CONDITIONAL_LAYER_CFGS] = {false};
+
+    for (int i = 0; i < NUM_CONDITIONAL_LAYER_CFGS; i++) {
+        const struct conditional_layer_cfg *cfg = CONDITIONAL_LAYER_CFGS + i;
+
+        entries[i].then_layer = cfg->then_layer;
+        zmk_keymap_layers_state_write(&then_layers_state_mask, cfg->then_layer, true);
+        zmk_keymap_layers_state_write(&conditional_layers_state_mask, cfg->then_layer, true);
+
+        for (int j = 0; j < cfg->if_layers_len; j++) {
+            if (cfg->if_layers[j] >= ZMK_KEYMAP_LAYERS_LEN) {
+                LOG_ERR("Conditional layer if-layer %d is not a layer in the keymap",
+                        cfg->if_layers[j]);
+                return -EINVAL;
             }
+
+            zmk_keymap_layers_state_write(&entries[i].if_layers_state_mask, cfg->if_layers[j],
+                                          true);
+            zmk_keymap_layers_state_write(&conditional_layers_state_mask, cfg->if_layers[j], true);
         }
+    }
+
+    // Order the table so every config comes after the configs whose then-layers it depends on.
+    for (int count = 0; count < NUM_CONDITIONAL_LAYER_CFGS; count++) {
+        int next = -1;
 
-        for (uint8_t layer = 0; layer <= max_then_layer; layer++) {
-            if ((BIT(layer) & then_layers) != 0U) {
-                if ((BIT(layer) & then_layer_state) != 0U) {
-                    conditional_layer_activate(layer);
-                } else {
-                    conditional_layer_deactivate(layer);
+        for (int i = 0; i < NUM_CONDITIONAL_LAYER_CFGS && next < 0; i++) {
+            if (placed[i]) {
+                continue;
+            }
+
+            next = i;
+            for (int j = 0; j < NUM_CONDITIONAL_LAYER_CFGS; j++) {
+                if (!placed[j] && conditional_layer_depends_on(&entries[i], &entries[j])) {
+                    next = -1;
+                    break;
                 }
             }
         }
+
+        if (next < 0) {
+            LOG_WRN("Conditional layers depend on each other in a loop");
+            conditional_layer_table_has_cycle = true;
+
+            for (int i = 0; i < NUM_CONDITIONAL_LAYER_CFGS; i++) {
+                if (!placed[i]) {
+                    placed[i] = true;
+                    conditional_layer_table[count++] = entries[i];
+                }
+            }
+            break;
+        }
+
+        placed[next] = true;
+        conditional_layer_table[count] = entries[next];
     }
 
-    k_sem_give(&conditional_layer_sem);
     return 0;
 }
 
 ZMK_LISTENER(conditional_layer, layer_state_changed_listener);
 ZMK_SUBSCRIPTION(conditional_layer, zmk_layer_state_changed);
 
+SYS_INIT(conditional_layer_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 #endif
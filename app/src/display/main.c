@@ -17,22 +17,28 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include "theme.h"
 
+#include <zmk/display.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/activity_state_changed.h>
 #include <zmk/display/status_screen.h>
+#include <zmk/power_level.h>
 
 static const struct device *display = DEVICE_DT_GET(DT_CHOSEN(zephyr_display));
 static bool initialized = false;
+static bool blanked = false;
 
 static lv_obj_t *screen;
 
 __attribute__((weak)) lv_obj_t *zmk_display_status_screen() { return NULL; }
 
-void display_tick_cb(struct k_work *work) { lv_task_handler(); }
+void display_tick_cb(struct k_work *work);
 
 #define TICK_MS 10
 
-K_WORK_DEFINE(display_tick_work, display_tick_cb);
+K_WORK_DELAYABLE_DEFINE(display_tick_work, display_tick_cb);
+
+static sys_slist_t pending_widget_updates = SYS_SLIST_STATIC_INIT(&pending_widget_updates);
+static struct k_spinlock pending_widget_updates_lock;
 
 #if IS_ENABLED(CONFIG_ZMK_DISPLAY_WORK_QUEUE_DEDICATED)
 
@@ -50,19 +56,77 @@ struct k_work_q *zmk_display_work_q() {
 #endif
 }
 
-void display_timer_cb() { k_work_submit_to_queue(zmk_display_work_q(), &display_tick_work); }
+static void schedule_display_tick(k_timeout_t delay) {
+    if (blanked) {
+        return;
+    }
+
+    k_work_reschedule_for_queue(zmk_display_work_q(), &display_tick_work, delay);
+}
+
+void display_tick_cb(struct k_work *work) {
+    uint32_t next = lv_task_handler();
+
+    // LVGL reports how long until its next timer is due, which is the refresh timer's period
+    // unless something else needs to run sooner, so wake up then rather than on a fixed tick.
+    if (next == LV_NO_TIMER_READY) {
+        next = TICK_MS;
+    }
+
+    schedule_display_tick(K_MSEC(MAX(next, zmk_power_level_scale_ms(TICK_MS))));
+}
+
+static void display_widget_update_cb(struct k_work *work) {
+    for (;;) {
+        k_spinlock_key_t key = k_spin_lock(&pending_widget_updates_lock);
+        sys_snode_t *node = sys_slist_get(&pending_widget_updates);
+        k_spin_unlock(&pending_widget_updates_lock, key);
+
+        if (node == NULL) {
+            break;
+        }
+
+        struct zmk_display_widget_update *update =
+            CONTAINER_OF(node, struct zmk_display_widget_update, node);
+
+        // Cleared first, so a change that arrives while updating is queued again.
+        atomic_clear(&update->pending);
+        update->update();
+    }
+
+    schedule_display_tick(K_NO_WAIT);
+}
+
+K_WORK_DELAYABLE_DEFINE(display_widget_update_work, display_widget_update_cb);
 
-K_TIMER_DEFINE(display_timer, display_timer_cb, NULL);
+void zmk_display_widget_request_update(struct zmk_display_widget_update *update) {
+    if (atomic_set(&update->pending, 1)) {
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&pending_widget_updates_lock);
+    sys_slist_append(&pending_widget_updates, &update->node);
+    k_spin_unlock(&pending_widget_updates_lock, key);
+
+    // Doesn't move an update that is already scheduled, so changes from several widgets that
+    // arrive close together are drawn in one go.
+    k_work_schedule_for_queue(
+        zmk_display_work_q(), &display_widget_update_work,
+        K_MSEC(zmk_power_level_scale_ms(CONFIG_ZMK_DISPLAY_UPDATE_DELAY_MS)));
+}
 
 void unblank_display_cb(struct k_work *work) {
     display_blanking_off(display);
-    k_timer_start(&display_timer, K_MSEC(TICK_MS), K_MSEC(TICK_MS));
+    blanked = false;
+
+    schedule_display_tick(K_MSEC(TICK_MS));
 }
 
 #if IS_ENABLED(CONFIG_ZMK_DISPLAY_BLANK_ON_IDLE)
 
 void blank_display_cb(struct k_work *work) {
-    k_timer_stop(&display_timer);
+    blanked = true;
+    k_work_cancel_delayable(&display_tick_work);
     display_blanking_on(display);
 }
 K_WORK_DEFINE(blank_display_work, blank_display_cb);
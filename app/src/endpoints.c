@@ -11,6 +11,7 @@
 
 #include <zmk/ble.h>
 #include <zmk/endpoints.h>
+#include <zmk/settings.h>
 #include <zmk/hid.h>
 #include <dt-bindings/zmk/hid_usage_pages.h>
 #include <zmk/usb_hid.h>
@@ -33,16 +34,17 @@ static enum zmk_transport preferred_transport =
 static void update_current_endpoint(void);
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-static void endpoints_save_preferred_work(struct k_work *work) {
-    settings_save_one("endpoints/preferred", &preferred_transport, sizeof(preferred_transport));
+static void endpoints_save_preferred(void) {
+    zmk_settings_save_one("endpoints/preferred", &preferred_transport,
+                          sizeof(preferred_transport));
 }
 
-static struct k_work_delayable endpoints_save_work;
+ZMK_SETTINGS_SAVER_DEFINE(endpoints_saver, endpoints_save_preferred);
 #endif
 
-static int endpoints_save_preferred(void) {
+static int endpoints_request_save(void) {
 #if IS_ENABLED(CONFIG_SETTINGS)
-    return k_work_reschedule(&endpoints_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+    return zmk_settings_save_request(&endpoints_saver);
 #else
     return 0;
 #endif
@@ -103,7 +105,7 @@ int zmk_endpoints_select_transport(enum zmk_transport transport) {
 
     preferred_transport = transport;
 
-    endpoints_save_preferred();
+    endpoints_request_save();
 
     update_current_endpoint();
 
@@ -312,8 +314,6 @@ static int zmk_endpoints_init(const struct device *_arg) {
         return err;
     }
 
-    k_work_init_delayable(&endpoints_save_work, endpoints_save_preferred_work);
-
     settings_load_subtree("endpoints");
 #endif
 
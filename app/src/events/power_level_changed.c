@@ -0,0 +1,10 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zmk/events/power_level_changed.h>
+
+ZMK_EVENT_IMPL(zmk_power_level_changed);
@@ -15,6 +15,7 @@
 #include <zephyr/drivers/gpio.h>
 
 #include <drivers/ext_power.h>
+#include <zmk/settings.h>
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
@@ -34,22 +35,21 @@ struct ext_power_generic_data {
 };
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-static void ext_power_save_state_work(struct k_work *work) {
+static void ext_power_write_state(void) {
     char setting_path[40];
     const struct device *ext_power = DEVICE_DT_GET(DT_DRV_INST(0));
     struct ext_power_generic_data *data = ext_power->data;
 
     snprintf(setting_path, sizeof(setting_path), "ext_power/state/%s", ext_power->name);
-    settings_save_one(setting_path, &data->status, sizeof(data->status));
+    zmk_settings_save_one(setting_path, &data->status, sizeof(data->status));
 }
 
-static struct k_work_delayable ext_power_save_work;
+ZMK_SETTINGS_SAVER_DEFINE(ext_power_saver, ext_power_write_state);
 #endif
 
 int ext_power_save_state(void) {
 #if IS_ENABLED(CONFIG_SETTINGS)
-    int ret = k_work_reschedule(&ext_power_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
-    return MIN(ret, 0);
+    return zmk_settings_save_request(&ext_power_saver);
 #else
     return 0;
 #endif
@@ -143,15 +143,13 @@ static int ext_power_generic_init(const struct device *dev) {
         return err;
     }
 
-    k_work_init_delayable(&ext_power_save_work, ext_power_save_state_work);
-
     // Set default value (on) if settings isn't set
     settings_load_subtree("ext_power");
     if (!data->settings_init) {
 
         data->status = true;
-        k_work_schedule(&ext_power_save_work, K_NO_WAIT);
 
+        // Enabling requests a save of the default state
         ext_power_enable(dev);
     }
 #else
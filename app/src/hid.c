@@ -5,6 +5,7 @@
  */
 
 #include "zmk/keys.h"
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -32,6 +33,27 @@ static struct zmk_hid_mouse_report mouse_report = {.report_id = ZMK_HID_REPORT_I
 
 #endif // IS_ENABLED(CONFIG_ZMK_MOUSE)
 
+#define SLOT_BITMAP_WORDS(len) DIV_ROUND_UP(len, 32)
+
+/**
+ * Find the lowest unused slot in a report array, given a bitmap of the used slots.
+ *
+ * @returns the slot index, or -ENOMEM if every slot is used.
+ */
+static int find_free_slot(const uint32_t *used_slots, const size_t len) {
+    for (int i = 0; i < SLOT_BITMAP_WORDS(len); i++) {
+        const int bit = find_lsb_set(~used_slots[i]);
+        if (bit == 0) {
+            continue;
+        }
+
+        const int slot = i * 32 + bit - 1;
+        return slot < len ? slot : -ENOMEM;
+    }
+
+    return -ENOMEM;
+}
+
 // Keep track of how often a modifier was pressed.
 // Only release the modifier if the count is 0.
 static int explicit_modifier_counts[8] = {0, 0, 0, 0, 0, 0, 0, 0};
@@ -173,18 +195,15 @@ static inline bool check_keyboard_usage(zmk_key_t usage) {
     return keyboard_report.body.keys[usage / 8] & (1 << (usage % 8));
 }
 
+static inline void clear_keyboard_usages(void) {}
+
 #elif IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_HKRO)
 
-#define TOGGLE_KEYBOARD(match, val)                                                                \
-    for (int idx = 0; idx < CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE; idx++) {                          \
-        if (keyboard_report.body.keys[idx] != match) {                                             \
-            continue;                                                                              \
-        }                                                                                          \
-        keyboard_report.body.keys[idx] = val;                                                      \
-        if (val) {                                                                                 \
-            break;                                                                                 \
-        }                                                                                          \
-    }
+// The report slot holding each usage plus one, or 0 if the usage is not in the report. This and
+// the bitmap of used slots let usages be pressed, released and checked without searching the
+// report.
+static uint8_t keyboard_usage_slots[UINT8_MAX + 1];
+static uint32_t keyboard_used_slots[SLOT_BITMAP_WORDS(CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE)];
 
 #if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
 zmk_hid_boot_report_t *zmk_hid_get_boot_report(void) {
@@ -220,59 +239,162 @@ zmk_hid_boot_report_t *zmk_hid_get_boot_report(void) {
 #endif /* IS_ENABLED(CONFIG_ZMK_USB_BOOT) */
 
 static inline int select_keyboard_usage(zmk_key_t usage) {
-    TOGGLE_KEYBOARD(0U, usage);
+    if (usage > UINT8_MAX) {
+        return -EINVAL;
+    }
 #if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
     ++keys_held;
 #endif
+    if (usage == 0 || keyboard_usage_slots[usage] != 0) {
+        return 0;
+    }
+
+    const int slot = find_free_slot(keyboard_used_slots, CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE);
+    if (slot < 0) {
+        // The report is full. The boot report will show the rollover.
+        return 0;
+    }
+
+    keyboard_report.body.keys[slot] = usage;
+    keyboard_usage_slots[usage] = slot + 1;
+    WRITE_BIT(keyboard_used_slots[slot / 32], slot % 32, true);
     return 0;
 }
 
 static inline int deselect_keyboard_usage(zmk_key_t usage) {
-    TOGGLE_KEYBOARD(usage, 0U);
+    if (usage > UINT8_MAX) {
+        return -EINVAL;
+    }
 #if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
     --keys_held;
 #endif
+    if (keyboard_usage_slots[usage] == 0) {
+        return 0;
+    }
+
+    const int slot = keyboard_usage_slots[usage] - 1;
+
+    keyboard_report.body.keys[slot] = 0;
+    keyboard_usage_slots[usage] = 0;
+    WRITE_BIT(keyboard_used_slots[slot / 32], slot % 32, false);
     return 0;
 }
 
 static inline int check_keyboard_usage(zmk_key_t usage) {
-    for (int idx = 0; idx < CONFIG_ZMK_HID_KEYBOARD_REPORT_SIZE; idx++) {
-        if (keyboard_report.body.keys[idx] == usage) {
-            return true;
-        }
-    }
-    return false;
+    return usage <= UINT8_MAX && keyboard_usage_slots[usage] != 0;
+}
+
+static inline void clear_keyboard_usages(void) {
+    memset(keyboard_usage_slots, 0, sizeof(keyboard_usage_slots));
+    memset(keyboard_used_slots, 0, sizeof(keyboard_used_slots));
 }
 
 #else
 #error "A proper HID report type must be selected"
 #endif
 
-#define TOGGLE_CONSUMER(match, val)                                                                \
-    COND_CODE_1(IS_ENABLED(CONFIG_ZMK_HID_CONSUMER_REPORT_USAGES_BASIC),                           \
-                (if (val > 0xFF) { return -ENOTSUP; }), ())                                        \
-    for (int idx = 0; idx < CONFIG_ZMK_HID_CONSUMER_REPORT_SIZE; idx++) {                          \
-        if (consumer_report.body.keys[idx] != match) {                                             \
-            continue;                                                                              \
-        }                                                                                          \
-        consumer_report.body.keys[idx] = val;                                                      \
-        if (val) {                                                                                 \
-            break;                                                                                 \
-        }                                                                                          \
-    }
-
-int zmk_hid_implicit_modifiers_press(zmk_mod_flags_t new_implicit_modifiers) {
-    implicit_modifiers = new_implicit_modifiers;
+#if IS_ENABLED(CONFIG_ZMK_HID_CONSUMER_REPORT_USAGES_BASIC)
+#define CONSUMER_MAX_USAGE 0xFF
+#else
+#define CONSUMER_MAX_USAGE 0xFFF
+#endif
+
+// Bitmaps of the usages in the consumer report and the used report slots, so usages can be
+// pressed and checked without searching the report.
+static uint32_t consumer_usages[SLOT_BITMAP_WORDS(CONSUMER_MAX_USAGE + 1)];
+static uint32_t consumer_used_slots[SLOT_BITMAP_WORDS(CONFIG_ZMK_HID_CONSUMER_REPORT_SIZE)];
+
+#define CONSUMER_USAGE_IS_SET(usage) ((consumer_usages[(usage) / 32] & BIT((usage) % 32)) != 0)
+
+#define IMPLICIT_MODIFIER_OWNERS_LEN 16
+
+struct implicit_modifier_owner {
+    uint32_t usage;
+    zmk_mod_flags_t modifiers;
+};
+
+// Keys which are held along with the implicit modifiers they were pressed with, from oldest to
+// newest. The newest held key's implicit modifiers are the ones applied, so a key is always sent
+// with its own implicit modifiers, and releasing an older key doesn't affect a newer one.
+static struct implicit_modifier_owner implicit_modifier_owners[IMPLICIT_MODIFIER_OWNERS_LEN];
+static size_t implicit_modifier_owners_len = 0;
+
+static int update_implicit_modifiers(void) {
+    if (implicit_modifier_owners_len > 0) {
+        implicit_modifiers = implicit_modifier_owners[implicit_modifier_owners_len - 1].modifiers;
+    } else {
+        implicit_modifiers = 0;
+    }
+
     zmk_mod_flags_t current = GET_MODIFIERS;
     SET_MODIFIERS(explicit_modifiers);
     return current == GET_MODIFIERS ? 0 : 1;
 }
 
-int zmk_hid_implicit_modifiers_release(void) {
+static void remove_implicit_modifier_owner(int index) {
+    implicit_modifier_owners_len--;
+    memmove(&implicit_modifier_owners[index], &implicit_modifier_owners[index + 1],
+            (implicit_modifier_owners_len - index) * sizeof(implicit_modifier_owners[0]));
+}
+
+int zmk_hid_implicit_modifiers_press(uint32_t usage, zmk_mod_flags_t new_implicit_modifiers) {
+    if (implicit_modifier_owners_len == IMPLICIT_MODIFIER_OWNERS_LEN) {
+        // Forget the oldest key. It can't own the modifiers again unless every newer key is
+        // released first.
+        remove_implicit_modifier_owner(0);
+    }
+
+    implicit_modifier_owners[implicit_modifier_owners_len++] = (struct implicit_modifier_owner){
+        .usage = usage,
+        .modifiers = new_implicit_modifiers,
+    };
+
+    return update_implicit_modifiers();
+}
+
+int zmk_hid_implicit_modifiers_release(uint32_t usage,
+                                       zmk_mod_flags_t released_implicit_modifiers) {
+    // Multiple held keys can send the same usage with different modifiers, such as PLUS and
+    // EQUAL, so prefer the key which matches both. Fall back to the usage alone, since behaviors
+    // such as caps word may only add modifiers to the press.
+    int index = -1;
+
+    for (int i = 0; i < implicit_modifier_owners_len; i++) {
+        const struct implicit_modifier_owner *owner = &implicit_modifier_owners[i];
+
+        if (owner->usage != usage) {
+            continue;
+        }
+
+        if (owner->modifiers == released_implicit_modifiers) {
+            index = i;
+            break;
+        }
+
+        if (index < 0) {
+            index = i;
+        }
+    }
+
+    if (index >= 0) {
+        remove_implicit_modifier_owner(index);
+    }
+
+    // A release can be lost, for example when a behavior is removed from the keymap while its key
+    // is held, so also forget any key whose usage has left the report. Otherwise its implicit
+    // modifiers would stay applied until the next key with implicit modifiers.
+    for (int i = implicit_modifier_owners_len - 1; i >= 0; i--) {
+        if (!zmk_hid_is_pressed(implicit_modifier_owners[i].usage)) {
+            remove_implicit_modifier_owner(i);
+        }
+    }
+
+    return update_implicit_modifiers();
+}
+
+static void clear_implicit_modifiers(void) {
+    implicit_modifier_owners_len = 0;
     implicit_modifiers = 0;
-    zmk_mod_flags_t current = GET_MODIFIERS;
-    SET_MODIFIERS(explicit_modifiers);
-    return current == GET_MODIFIERS ? 0 : 1;
 }
 
 int zmk_hid_masked_modifiers_set(zmk_mod_flags_t new_masked_modifiers) {
@@ -314,29 +436,55 @@ bool zmk_hid_keyboard_is_pressed(zmk_key_t code) {
 
 void zmk_hid_keyboard_clear(void) {
     memset(&keyboard_report.body, 0, sizeof(keyboard_report.body));
+    clear_keyboard_usages();
+    clear_implicit_modifiers();
 }
 
 int zmk_hid_consumer_press(zmk_key_t code) {
-    TOGGLE_CONSUMER(0U, code);
+    if (code > CONSUMER_MAX_USAGE) {
+        return -ENOTSUP;
+    }
+
+    if (code == 0 || CONSUMER_USAGE_IS_SET(code)) {
+        return 0;
+    }
+
+    const int slot = find_free_slot(consumer_used_slots, CONFIG_ZMK_HID_CONSUMER_REPORT_SIZE);
+    if (slot < 0) {
+        return 0;
+    }
+
+    consumer_report.body.keys[slot] = code;
+    WRITE_BIT(consumer_usages[code / 32], code % 32, true);
+    WRITE_BIT(consumer_used_slots[slot / 32], slot % 32, true);
     return 0;
 };
 
 int zmk_hid_consumer_release(zmk_key_t code) {
-    TOGGLE_CONSUMER(code, 0U);
+    if (code > CONSUMER_MAX_USAGE || !CONSUMER_USAGE_IS_SET(code)) {
+        return 0;
+    }
+
+    for (int idx = 0; idx < CONFIG_ZMK_HID_CONSUMER_REPORT_SIZE; idx++) {
+        if (consumer_report.body.keys[idx] == code) {
+            consumer_report.body.keys[idx] = 0;
+            WRITE_BIT(consumer_used_slots[idx / 32], idx % 32, false);
+            break;
+        }
+    }
+
+    WRITE_BIT(consumer_usages[code / 32], code % 32, false);
     return 0;
 };
 
 void zmk_hid_consumer_clear(void) {
     memset(&consumer_report.body, 0, sizeof(consumer_report.body));
+    memset(consumer_usages, 0, sizeof(consumer_usages));
+    memset(consumer_used_slots, 0, sizeof(consumer_used_slots));
 }
 
 bool zmk_hid_consumer_is_pressed(zmk_key_t key) {
-    for (int idx = 0; idx < CONFIG_ZMK_HID_CONSUMER_REPORT_SIZE; idx++) {
-        if (consumer_report.body.keys[idx] == key) {
-            return true;
-        }
-    }
-    return false;
+    return key <= CONSUMER_MAX_USAGE && CONSUMER_USAGE_IS_SET(key);
 }
 
 int zmk_hid_press(uint32_t usage) {
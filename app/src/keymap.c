@@ -4,7 +4,14 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <drivers/behavior.h>
+#include <zephyr/init.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/sys/util.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/logging/log.h>
@@ -14,6 +21,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/keymap.h>
 #include <zmk/matrix.h>
 #include <zmk/sensors.h>
+#include <zmk/settings.h>
 #include <zmk/virtual_key_position.h>
 
 #include <zmk/ble.h>
@@ -26,7 +34,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/events/layer_state_changed.h>
 #include <zmk/events/sensor_event.h>
 
-static zmk_keymap_layers_state_t _zmk_keymap_layer_state = 0;
+static zmk_keymap_layers_state_t _zmk_keymap_layer_state;
 static uint8_t _zmk_keymap_layer_default = 0;
 
 #define DT_DRV_COMPAT zmk_keymap
@@ -59,11 +67,36 @@ static uint8_t _zmk_keymap_layer_default = 0;
 // When a behavior handles a key position "down" event, we record the layer state
 // here so that even if that layer is deactivated before the "up", event, we
 // still send the release event to the behavior in that layer also.
-static uint32_t zmk_keymap_active_behavior_layer[ZMK_KEYMAP_LEN];
+static zmk_keymap_layers_state_t zmk_keymap_active_behavior_layer[ZMK_KEYMAP_LEN];
 
 static struct zmk_behavior_binding zmk_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN] = {
     DT_INST_FOREACH_CHILD_SEP(0, TRANSFORMED_LAYER, (, ))};
 
+// The behavior driver resolved for each binding, so a key event does not have to look the behavior
+// up by name. Kept in sync with zmk_keymap whenever a binding changes.
+struct zmk_keymap_dispatch {
+    const struct behavior_driver_api *api;
+    uint8_t locality;
+    bool convert_params;
+};
+
+static struct zmk_keymap_dispatch zmk_keymap_dispatch[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN];
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_RUNTIME)
+
+// The keymap as built from devicetree, so runtime changes can be reverted and only the bindings
+// that differ from it need to be persisted.
+static const struct zmk_behavior_binding
+    zmk_keymap_default[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN] = {
+        DT_INST_FOREACH_CHILD_SEP(0, TRANSFORMED_LAYER, (, ))};
+
+#define KEYMAP_BINDING_INDEX(layer, position) ((layer) * ZMK_KEYMAP_LEN + (position))
+
+// One bit per binding that changed since the last time changes were written to settings.
+static ATOMIC_DEFINE(zmk_keymap_pending_changes, ZMK_KEYMAP_LAYERS_LEN * ZMK_KEYMAP_LEN);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_RUNTIME) */
+
 static const char *zmk_keymap_layer_names[ZMK_KEYMAP_LAYERS_LEN] = {
     DT_INST_FOREACH_CHILD_SEP(0, LAYER_NAME, (, ))};
 
@@ -73,6 +106,15 @@ static struct zmk_behavior_binding
     zmk_sensor_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_SENSORS_LEN] = {
         DT_INST_FOREACH_CHILD_SEP(0, SENSOR_LAYER, (, ))};
 
+// Per sensor, the layers with a behavior bound to it, and the subset of those whose behavior wants
+// sensor data even when it can't be triggered. Built once at init, so events skip the rest.
+static zmk_keymap_layers_state_t zmk_sensor_keymap_bound_layers[ZMK_KEYMAP_SENSORS_LEN];
+static zmk_keymap_layers_state_t zmk_sensor_keymap_inactive_data_layers[ZMK_KEYMAP_SENSORS_LEN];
+
+// Per sensor, the layers with a behavior bound to it that wasn't ready at init. They are looked up
+// again on the sensor's next event, so a behavior that initializes later still gets its events.
+static zmk_keymap_layers_state_t zmk_sensor_keymap_unresolved_layers[ZMK_KEYMAP_SENSORS_LEN];
+
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
 static inline int set_layer_state(uint8_t layer, bool state) {
@@ -80,43 +122,81 @@ static inline int set_layer_state(uint8_t layer, bool state) {
         return -EINVAL;
     }
 
+    zmk_keymap_layers_state_t new_state = _zmk_keymap_layer_state;
+
+    zmk_keymap_layers_state_write(&new_state, layer, state);
+
+    return zmk_keymap_layer_state_set(new_state);
+}
+
+uint8_t zmk_keymap_layer_default(void) { return _zmk_keymap_layer_default; }
+
+zmk_keymap_layers_state_t zmk_keymap_layer_state(void) { return _zmk_keymap_layer_state; }
+
+static void zmk_keymap_update_dispatch(uint8_t layer, uint32_t position) {
+    struct zmk_keymap_dispatch *dispatch = &zmk_keymap_dispatch[layer][position];
+    const struct device *behavior =
+        zmk_behavior_get_binding(zmk_keymap[layer][position].behavior_dev);
+
+    if (!behavior) {
+        *dispatch = (struct zmk_keymap_dispatch){0};
+        return;
+    }
+
+    const struct behavior_driver_api *api = (const struct behavior_driver_api *)behavior->api;
+
+    *dispatch = (struct zmk_keymap_dispatch){
+        .api = api,
+        .locality = api->locality,
+        .convert_params = api->binding_convert_central_state_dependent_params != NULL,
+    };
+}
+
+int zmk_keymap_layer_state_set(zmk_keymap_layers_state_t state) {
     // Default layer should *always* remain active
-    if (layer == _zmk_keymap_layer_default && !state) {
+    zmk_keymap_layers_state_write(
+        &state, _zmk_keymap_layer_default,
+        zmk_keymap_layers_state_test(&_zmk_keymap_layer_state, _zmk_keymap_layer_default) ||
+            zmk_keymap_layers_state_test(&state, _zmk_keymap_layer_default));
+
+    zmk_keymap_layers_state_t changed =
+        zmk_keymap_layers_state_diff(&_zmk_keymap_layer_state, &state);
+
+    // Don't send state changes unless there was an actual change
+    if (zmk_keymap_layers_state_highest(&changed) < 0) {
         return 0;
     }
 
     zmk_keymap_layers_state_t old_state = _zmk_keymap_layer_state;
-    WRITE_BIT(_zmk_keymap_layer_state, layer, state);
-    // Don't send state changes unless there was an actual change
-    if (old_state != _zmk_keymap_layer_state) {
-        LOG_DBG("layer_changed: layer %d state %d", layer, state);
-        ZMK_EVENT_RAISE(create_layer_state_changed(layer, state));
+    _zmk_keymap_layer_state = state;
+
+    int layer;
+    ZMK_KEYMAP_LAYERS_STATE_FOREACH_DESC(&changed, layer) {
+        LOG_DBG("layer_changed: layer %d state %d", layer,
+                zmk_keymap_layers_state_test(&state, layer));
     }
 
+    // Any number of layers can change at once, but listeners are only notified once.
+    ZMK_EVENT_RAISE(create_layer_state_changed(&old_state, &state));
+
     return 0;
 }
 
-uint8_t zmk_keymap_layer_default(void) { return _zmk_keymap_layer_default; }
-
-zmk_keymap_layers_state_t zmk_keymap_layer_state(void) { return _zmk_keymap_layer_state; }
-
-bool zmk_keymap_layer_active_with_state(uint8_t layer, zmk_keymap_layers_state_t state_to_test) {
+bool zmk_keymap_layer_active_with_state(uint8_t layer,
+                                        const zmk_keymap_layers_state_t *state_to_test) {
     // The default layer is assumed to be ALWAYS ACTIVE so we include an || here to ensure nobody
     // breaks up that assumption by accident
-    return (state_to_test & (BIT(layer))) == (BIT(layer)) || layer == _zmk_keymap_layer_default;
+    return zmk_keymap_layers_state_test(state_to_test, layer) || layer == _zmk_keymap_layer_default;
 };
 
 bool zmk_keymap_layer_active(uint8_t layer) {
-    return zmk_keymap_layer_active_with_state(layer, _zmk_keymap_layer_state);
+    return zmk_keymap_layer_active_with_state(layer, &_zmk_keymap_layer_state);
 };
 
 uint8_t zmk_keymap_highest_layer_active(void) {
-    for (uint8_t layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer > 0; layer--) {
-        if (zmk_keymap_layer_active(layer)) {
-            return layer;
-        }
-    }
-    return zmk_keymap_layer_default();
+    int layer = zmk_keymap_layers_state_highest(&_zmk_keymap_layer_state);
+
+    return MAX(layer, _zmk_keymap_layer_default);
 }
 
 int zmk_keymap_layer_activate(uint8_t layer) { return set_layer_state(layer, true); };
@@ -132,17 +212,58 @@ int zmk_keymap_layer_toggle(uint8_t layer) {
 };
 
 int zmk_keymap_layer_to(uint8_t layer) {
+    struct zmk_keymap_layer_transaction txn;
+
+    zmk_keymap_layer_transaction_begin(&txn);
+
     for (int i = ZMK_KEYMAP_LAYERS_LEN - 1; i >= 0; i--) {
-        zmk_keymap_layer_deactivate(i);
+        zmk_keymap_layer_transaction_deactivate(&txn, i);
+    }
+
+    int ret = zmk_keymap_layer_transaction_activate(&txn, layer);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return zmk_keymap_layer_transaction_commit(&txn);
+}
+
+void zmk_keymap_layer_transaction_begin(struct zmk_keymap_layer_transaction *txn) {
+    *txn = (struct zmk_keymap_layer_transaction){0};
+}
+
+int zmk_keymap_layer_transaction_activate(struct zmk_keymap_layer_transaction *txn,
+                                          uint8_t layer) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
+        return -EINVAL;
+    }
+
+    zmk_keymap_layers_state_write(&txn->activate, layer, true);
+    zmk_keymap_layers_state_write(&txn->deactivate, layer, false);
+
+    return 0;
+}
+
+int zmk_keymap_layer_transaction_deactivate(struct zmk_keymap_layer_transaction *txn,
+                                            uint8_t layer) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
+        return -EINVAL;
     }
 
-    zmk_keymap_layer_activate(layer);
+    zmk_keymap_layers_state_write(&txn->activate, layer, false);
+    zmk_keymap_layers_state_write(&txn->deactivate, layer, true);
 
     return 0;
 }
 
-bool is_active_layer(uint8_t layer, zmk_keymap_layers_state_t layer_state) {
-    return (layer_state & BIT(layer)) == BIT(layer) || layer == _zmk_keymap_layer_default;
+int zmk_keymap_layer_transaction_commit(struct zmk_keymap_layer_transaction *txn) {
+    zmk_keymap_layers_state_t state = _zmk_keymap_layer_state;
+
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        state.words[i] = (state.words[i] & ~txn->deactivate.words[i]) | txn->activate.words[i];
+    }
+
+    return zmk_keymap_layer_state_set(state);
 }
 
 const char *zmk_keymap_layer_name(uint8_t layer) {
@@ -153,13 +274,145 @@ const char *zmk_keymap_layer_name(uint8_t layer) {
     return zmk_keymap_layer_names[layer];
 }
 
-int invoke_locally(struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event,
-                   bool pressed) {
-    if (pressed) {
-        return behavior_keymap_binding_pressed(binding, event);
-    } else {
-        return behavior_keymap_binding_released(binding, event);
+const struct zmk_behavior_binding *zmk_keymap_get_layer_binding_at_idx(uint8_t layer,
+                                                                       uint32_t position) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN || position >= ZMK_KEYMAP_LEN) {
+        return NULL;
+    }
+
+    return &zmk_keymap[layer][position];
+}
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_RUNTIME)
+
+#if IS_ENABLED(CONFIG_SETTINGS)
+
+// Value stored for each binding that differs from the devicetree keymap. The behavior is stored by
+// name since device pointers are not stable across firmware builds.
+struct zmk_keymap_binding_setting {
+    uint32_t param1;
+    uint32_t param2;
+    char behavior_dev[CONFIG_ZMK_KEYMAP_RUNTIME_BEHAVIOR_NAME_MAX_LEN];
+} __packed;
+
+static void zmk_keymap_binding_setting_name(char *buf, size_t len, uint8_t layer,
+                                            uint32_t position) {
+    snprintf(buf, len, "keymap/l/%d/%d", layer, position);
+}
+
+static int zmk_keymap_save_binding(uint8_t layer, uint32_t position) {
+    const struct zmk_behavior_binding *binding = &zmk_keymap[layer][position];
+    const struct zmk_behavior_binding *default_binding = &zmk_keymap_default[layer][position];
+    char setting_name[24];
+
+    zmk_keymap_binding_setting_name(setting_name, sizeof(setting_name), layer, position);
+
+    if (strcmp(binding->behavior_dev, default_binding->behavior_dev) == 0 &&
+        binding->param1 == default_binding->param1 && binding->param2 == default_binding->param2) {
+        // Reverted to the devicetree binding, so there is no longer a delta to keep around.
+        return zmk_settings_delete(setting_name);
     }
+
+    struct zmk_keymap_binding_setting setting = {
+        .param1 = binding->param1,
+        .param2 = binding->param2,
+    };
+    size_t name_len = strlen(binding->behavior_dev);
+
+    memcpy(setting.behavior_dev, binding->behavior_dev, name_len);
+
+    return zmk_settings_save_one(setting_name, &setting,
+                                 offsetof(struct zmk_keymap_binding_setting, behavior_dev) +
+                                     name_len);
+}
+
+static void zmk_keymap_save_pending_changes(void) {
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_LEN * ZMK_KEYMAP_LEN; i++) {
+        if (!atomic_test_and_clear_bit(zmk_keymap_pending_changes, i)) {
+            continue;
+        }
+
+        int err = zmk_keymap_save_binding(i / ZMK_KEYMAP_LEN, i % ZMK_KEYMAP_LEN);
+        if (err) {
+            LOG_ERR("Failed to save binding %d on layer %d (err %d)", i % ZMK_KEYMAP_LEN,
+                    i / ZMK_KEYMAP_LEN, err);
+        }
+    }
+}
+
+ZMK_SETTINGS_SAVER_DEFINE(zmk_keymap_saver, zmk_keymap_save_pending_changes);
+
+#endif /* IS_ENABLED(CONFIG_SETTINGS) */
+
+static int zmk_keymap_schedule_save(uint8_t layer, uint32_t position) {
+    atomic_set_bit(zmk_keymap_pending_changes, KEYMAP_BINDING_INDEX(layer, position));
+
+#if IS_ENABLED(CONFIG_SETTINGS)
+    // Every change made within the debounce window is written out together in one batch.
+    return zmk_settings_save_request(&zmk_keymap_saver);
+#else
+    return 0;
+#endif
+}
+
+int zmk_keymap_set_layer_binding_at_idx(uint8_t layer, uint32_t position,
+                                        struct zmk_behavior_binding binding) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN || position >= ZMK_KEYMAP_LEN) {
+        return -EINVAL;
+    }
+
+    const struct device *behavior = zmk_behavior_get_binding(binding.behavior_dev);
+    if (!behavior) {
+        LOG_WRN("No behavior named %s", binding.behavior_dev);
+        return -ENODEV;
+    }
+
+    if (strlen(behavior->name) > CONFIG_ZMK_KEYMAP_RUNTIME_BEHAVIOR_NAME_MAX_LEN) {
+        return -ENAMETOOLONG;
+    }
+
+    // Keep a pointer to the device's own name, so the binding does not reference caller memory.
+    binding.behavior_dev = (char *)behavior->name;
+    zmk_keymap[layer][position] = binding;
+    zmk_keymap_update_dispatch(layer, position);
+
+    LOG_DBG("layer: %d position: %d, binding name: %s", layer, position, binding.behavior_dev);
+
+    return zmk_keymap_schedule_save(layer, position);
+}
+
+int zmk_keymap_reset_layer_binding_at_idx(uint8_t layer, uint32_t position) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN || position >= ZMK_KEYMAP_LEN) {
+        return -EINVAL;
+    }
+
+    zmk_keymap[layer][position] = zmk_keymap_default[layer][position];
+    zmk_keymap_update_dispatch(layer, position);
+
+    return zmk_keymap_schedule_save(layer, position);
+}
+
+int zmk_keymap_save_changes(void) {
+#if IS_ENABLED(CONFIG_SETTINGS)
+    return zmk_settings_save_now();
+#else
+    return -ENOTSUP;
+#endif
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_RUNTIME) */
+
+static int invoke_locally(const struct behavior_driver_api *api,
+                          struct zmk_behavior_binding *binding,
+                          struct zmk_behavior_binding_event event, bool pressed) {
+    behavior_keymap_binding_callback_t callback =
+        pressed ? api->binding_pressed : api->binding_released;
+
+    if (callback == NULL) {
+        return -ENOTSUP;
+    }
+
+    return callback(binding, event);
 }
 
 int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position, bool pressed,
@@ -167,7 +420,7 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
     // We want to make a copy of this, since it may be converted from
     // relative to absolute before being invoked
     struct zmk_behavior_binding binding = zmk_keymap[layer][position];
-    const struct device *behavior;
+    const struct zmk_keymap_dispatch *dispatch = &zmk_keymap_dispatch[layer][position];
     struct zmk_behavior_binding_event event = {
         .layer = layer,
         .position = position,
@@ -176,38 +429,41 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
 
     LOG_DBG("layer: %d position: %d, binding name: %s", layer, position, binding.behavior_dev);
 
-    behavior = zmk_behavior_get_binding(binding.behavior_dev);
+    // The behavior may not have been ready when the dispatch table was built, so retry the lookup
+    // rather than treating the key as unbound forever.
+    if (!dispatch->api) {
+        zmk_keymap_update_dispatch(layer, position);
+    }
+
+    const struct behavior_driver_api *api = dispatch->api;
 
-    if (!behavior) {
+    if (!api) {
         LOG_WRN("No behavior assigned to %d on layer %d", position, layer);
         return 1;
     }
 
-    int err = behavior_keymap_binding_convert_central_state_dependent_params(&binding, event);
-    if (err) {
-        LOG_ERR("Failed to convert relative to absolute behavior binding (err %d)", err);
-        return err;
+    if (dispatch->convert_params) {
+        int err = api->binding_convert_central_state_dependent_params(&binding, event);
+        if (err) {
+            LOG_ERR("Failed to convert relative to absolute behavior binding (err %d)", err);
+            return err;
+        }
     }
 
-    enum behavior_locality locality = BEHAVIOR_LOCALITY_CENTRAL;
-    err = behavior_get_locality(behavior, &locality);
-    if (err) {
-        LOG_ERR("Failed to get behavior locality %d", err);
-        return err;
-    }
+    enum behavior_locality locality = dispatch->locality;
 
     switch (locality) {
     case BEHAVIOR_LOCALITY_CENTRAL:
-        return invoke_locally(&binding, event, pressed);
+        return invoke_locally(api, &binding, event, pressed);
     case BEHAVIOR_LOCALITY_EVENT_SOURCE:
 #if ZMK_BLE_IS_CENTRAL
         if (source == ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL) {
-            return invoke_locally(&binding, event, pressed);
+            return invoke_locally(api, &binding, event, pressed);
         } else {
             return zmk_split_bt_invoke_behavior(source, &binding, event, pressed);
         }
 #else
-        return invoke_locally(&binding, event, pressed);
+        return invoke_locally(api, &binding, event, pressed);
 #endif
     case BEHAVIOR_LOCALITY_GLOBAL:
 #if ZMK_BLE_IS_CENTRAL
@@ -215,7 +471,7 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
             zmk_split_bt_invoke_behavior(i, &binding, event, pressed);
         }
 #endif
-        return invoke_locally(&binding, event, pressed);
+        return invoke_locally(api, &binding, event, pressed);
     }
 
     return -ENOTSUP;
@@ -225,19 +481,28 @@ int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pr
                                       int64_t timestamp) {
     if (pressed) {
         zmk_keymap_active_behavior_layer[position] = _zmk_keymap_layer_state;
+        // The default layer is always active, so record it along with the others to let the loop
+        // below only visit set bits.
+        zmk_keymap_layers_state_write(&zmk_keymap_active_behavior_layer[position],
+                                      _zmk_keymap_layer_default, true);
     }
-    for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= _zmk_keymap_layer_default; layer--) {
-        if (zmk_keymap_layer_active_with_state(layer, zmk_keymap_active_behavior_layer[position])) {
-            int ret = zmk_keymap_apply_position_state(source, layer, position, pressed, timestamp);
-            if (ret > 0) {
-                LOG_DBG("behavior processing to continue to next layer");
-                continue;
-            } else if (ret < 0) {
-                LOG_DBG("Behavior returned error: %d", ret);
-                return ret;
-            } else {
-                return ret;
-            }
+
+    const zmk_keymap_layers_state_t *layers = &zmk_keymap_active_behavior_layer[position];
+    int layer;
+    ZMK_KEYMAP_LAYERS_STATE_FOREACH_DESC(layers, layer) {
+        if (layer < _zmk_keymap_layer_default) {
+            break;
+        }
+
+        int ret = zmk_keymap_apply_position_state(source, layer, position, pressed, timestamp);
+        if (ret > 0) {
+            LOG_DBG("behavior processing to continue to next layer");
+            continue;
+        } else if (ret < 0) {
+            LOG_DBG("Behavior returned error: %d", ret);
+            return ret;
+        } else {
+            return ret;
         }
     }
 
@@ -245,23 +510,53 @@ int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pr
 }
 
 #if ZMK_KEYMAP_HAS_SENSORS
+static void zmk_keymap_update_sensor_layer(uint8_t sensor_index, uint8_t layer) {
+    const char *name = zmk_sensor_keymap[layer][sensor_index].behavior_dev;
+    const struct device *behavior = zmk_behavior_get_binding(name);
+
+    zmk_keymap_layers_state_write(&zmk_sensor_keymap_unresolved_layers[sensor_index], layer,
+                                  !behavior && name && name[0] != '\0');
+
+    if (!behavior) {
+        return;
+    }
+
+    const struct behavior_driver_api *api = (const struct behavior_driver_api *)behavior->api;
+
+    zmk_keymap_layers_state_write(&zmk_sensor_keymap_bound_layers[sensor_index], layer, true);
+    zmk_keymap_layers_state_write(&zmk_sensor_keymap_inactive_data_layers[sensor_index], layer,
+                                  api->sensor_binding_accepts_inactive_data);
+}
+
 int zmk_keymap_sensor_event(uint8_t sensor_index,
                             const struct zmk_sensor_channel_data *channel_data,
                             size_t channel_data_size, int64_t timestamp) {
     bool opaque_response = false;
 
-    for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= 0; layer--) {
+    zmk_keymap_layers_state_t active_layers = _zmk_keymap_layer_state;
+    zmk_keymap_layers_state_write(&active_layers, _zmk_keymap_layer_default, true);
+
+    const zmk_keymap_layers_state_t unresolved = zmk_sensor_keymap_unresolved_layers[sensor_index];
+    int layer;
+    ZMK_KEYMAP_LAYERS_STATE_FOREACH_DESC(&unresolved, layer) {
+        zmk_keymap_update_sensor_layer(sensor_index, layer);
+    }
+
+    // Only visit layers with a binding for this sensor that is either active or wants data anyway.
+    const zmk_keymap_layers_state_t *bound = &zmk_sensor_keymap_bound_layers[sensor_index];
+    const zmk_keymap_layers_state_t *inactive_data =
+        &zmk_sensor_keymap_inactive_data_layers[sensor_index];
+    zmk_keymap_layers_state_t layers;
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        layers.words[i] = (active_layers.words[i] & bound->words[i]) | inactive_data->words[i];
+    }
+
+    ZMK_KEYMAP_LAYERS_STATE_FOREACH_DESC(&layers, layer) {
         struct zmk_behavior_binding *binding = &zmk_sensor_keymap[layer][sensor_index];
 
         LOG_DBG("layer: %d sensor_index: %d, binding name: %s", layer, sensor_index,
                 binding->behavior_dev);
 
-        const struct device *behavior = zmk_behavior_get_binding(binding->behavior_dev);
-        if (!behavior) {
-            LOG_DBG("No behavior assigned to %d on layer %d", sensor_index, layer);
-            continue;
-        }
-
         struct zmk_behavior_binding_event event = {
             .layer = layer,
             .position = ZMK_VIRTUAL_KEY_POSITION_SENSOR(sensor_index),
@@ -281,15 +576,20 @@ int zmk_keymap_sensor_event(uint8_t sensor_index,
 
         enum behavior_sensor_binding_process_mode mode =
             (!opaque_response && layer >= _zmk_keymap_layer_default &&
-             zmk_keymap_layer_active(layer))
+             zmk_keymap_layers_state_test(&active_layers, layer))
                 ? BEHAVIOR_SENSOR_BINDING_PROCESS_MODE_TRIGGER
                 : BEHAVIOR_SENSOR_BINDING_PROCESS_MODE_DISCARD;
 
         ret = behavior_sensor_keymap_binding_process(binding, event, mode);
 
-        if (ret == ZMK_BEHAVIOR_OPAQUE) {
+        if (ret == ZMK_BEHAVIOR_OPAQUE && !opaque_response) {
             LOG_DBG("sensor event processing complete, behavior response was opaque");
             opaque_response = true;
+
+            // Nothing below can trigger now, so only the layers that want data anyway remain.
+            for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+                layers.words[i] &= inactive_data->words[i];
+            }
         } else if (ret < 0) {
             LOG_DBG("Behavior returned error: %d", ret);
             return ret;
@@ -299,8 +599,32 @@ int zmk_keymap_sensor_event(uint8_t sensor_index,
     return 0;
 }
 
+static int zmk_keymap_sensors_init(const struct device *_arg) {
+    for (int sensor_index = 0; sensor_index < ZMK_KEYMAP_SENSORS_LEN; sensor_index++) {
+        for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+            zmk_keymap_update_sensor_layer(sensor_index, layer);
+        }
+    }
+
+    return 0;
+}
+
+SYS_INIT(zmk_keymap_sensors_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
+static int zmk_keymap_dispatch_init(const struct device *_arg) {
+    for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+        for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+            zmk_keymap_update_dispatch(layer, position);
+        }
+    }
+
+    return 0;
+}
+
+SYS_INIT(zmk_keymap_dispatch_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 int keymap_listener(const zmk_event_t *eh) {
     const struct zmk_position_state_changed *pos_ev;
     if ((pos_ev = as_zmk_position_state_changed(eh)) != NULL) {
@@ -325,3 +649,86 @@ ZMK_SUBSCRIPTION(keymap, zmk_position_state_changed);
 #if ZMK_KEYMAP_HAS_SENSORS
 ZMK_SUBSCRIPTION(keymap, zmk_sensor_event);
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_RUNTIME) && IS_ENABLED(CONFIG_SETTINGS)
+
+static int keymap_handle_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    const char *next;
+
+    if (!settings_name_steq(name, "l", &next) || !next) {
+        return 0;
+    }
+
+    char *endptr;
+    unsigned long layer = strtoul(next, &endptr, 10);
+    if (*endptr != '/') {
+        LOG_WRN("Invalid keymap setting name: %s", name);
+        return -EINVAL;
+    }
+
+    unsigned long position = strtoul(endptr + 1, &endptr, 10);
+    if (*endptr != '\0') {
+        LOG_WRN("Invalid keymap setting name: %s", name);
+        return -EINVAL;
+    }
+
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN || position >= ZMK_KEYMAP_LEN) {
+        LOG_WRN("Stored binding %lu on layer %lu is outside the keymap", position, layer);
+        return -EINVAL;
+    }
+
+    if (len <= offsetof(struct zmk_keymap_binding_setting, behavior_dev) ||
+        len > sizeof(struct zmk_keymap_binding_setting)) {
+        LOG_ERR("Invalid keymap binding size (got %d)", len);
+        return -EINVAL;
+    }
+
+    struct zmk_keymap_binding_setting setting = {0};
+    char behavior_dev[CONFIG_ZMK_KEYMAP_RUNTIME_BEHAVIOR_NAME_MAX_LEN + 1] = {0};
+
+    int err = read_cb(cb_arg, &setting, len);
+    if (err <= 0) {
+        LOG_ERR("Failed to handle keymap binding from settings (err %d)", err);
+        return err;
+    }
+
+    memcpy(behavior_dev, setting.behavior_dev,
+           len - offsetof(struct zmk_keymap_binding_setting, behavior_dev));
+
+    const struct device *behavior = zmk_behavior_get_binding(behavior_dev);
+    if (!behavior) {
+        // The behavior may have been removed from the firmware since the binding was saved, so
+        // keep the devicetree binding in that case.
+        LOG_WRN("Stored binding references unknown behavior %s", behavior_dev);
+        return 0;
+    }
+
+    zmk_keymap[layer][position] = (struct zmk_behavior_binding){
+        .behavior_dev = (char *)behavior->name,
+        .param1 = setting.param1,
+        .param2 = setting.param2,
+    };
+    zmk_keymap_update_dispatch(layer, position);
+
+    return 0;
+}
+
+struct settings_handler keymap_handler = {.name = "keymap", .h_set = keymap_handle_set};
+
+static int keymap_init(const struct device *_arg) {
+    settings_subsys_init();
+
+    int err = settings_register(&keymap_handler);
+    if (err) {
+        LOG_ERR("Failed to register the keymap settings handler (err %d)", err);
+        return err;
+    }
+
+    settings_load_subtree("keymap");
+
+    return 0;
+}
+
+SYS_INIT(keymap_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_RUNTIME) && IS_ENABLED(CONFIG_SETTINGS) */
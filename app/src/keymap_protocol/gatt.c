@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/keymap_protocol.h>
+
+#define ZMK_BT_KEYMAP_PROTOCOL_UUID(num)                                                           \
+    BT_UUID_128_ENCODE(num, 0x4b3e, 0x4a8c, 0x9c1d, 0x6b1f2a7d5e10)
+#define ZMK_KEYMAP_PROTOCOL_BT_SERVICE_UUID ZMK_BT_KEYMAP_PROTOCOL_UUID(0x00000000)
+#define ZMK_KEYMAP_PROTOCOL_BT_CHAR_FRAME_UUID ZMK_BT_KEYMAP_PROTOCOL_UUID(0x00000001)
+
+static uint8_t request[ZMK_KEYMAP_PROTOCOL_MAX_FRAME_LEN];
+static size_t request_len;
+
+// Set while the writes of a long request are arriving. Only a write at offset 0 opens a request, so
+// bytes left over from an abandoned one are never taken as part of the next.
+static bool request_open;
+
+static uint8_t response[ZMK_KEYMAP_PROTOCOL_MAX_FRAME_LEN];
+static size_t response_len;
+
+// Set from when a complete request has been received until its response is ready, so a new
+// request can't overwrite the one being handled.
+static atomic_t request_pending;
+
+static void keymap_svc_request_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(keymap_svc_request_work, keymap_svc_request_work_handler);
+
+static ssize_t keymap_svc_read_response(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                        void *buf, uint16_t len, uint16_t offset) {
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, response, response_len);
+}
+
+static ssize_t keymap_svc_write_request(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                        const void *buf, uint16_t len, uint16_t offset,
+                                        uint8_t flags) {
+    uint16_t end_addr = offset + len;
+
+    if (end_addr > sizeof(request)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    if (atomic_get(&request_pending)) {
+        return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+    }
+
+    if (offset == 0) {
+        if (len == 0) {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+
+        request_open = true;
+    } else if (!request_open || offset != request_len) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    memcpy(request + offset, buf, len);
+    request_len = end_addr;
+
+    if (request_len > request[0] + 1) {
+        request_open = false;
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    // Long requests arrive in several writes, so only handle the request once the whole frame
+    // described by its length byte is here.
+    if (request_len == request[0] + 1) {
+        request_open = false;
+        atomic_set(&request_pending, true);
+        k_work_submit(&keymap_svc_request_work);
+    }
+
+    return len;
+}
+
+static void keymap_svc_frame_ccc(const struct bt_gatt_attr *attr, uint16_t value) {
+    LOG_DBG("value %d", value);
+}
+
+BT_GATT_SERVICE_DEFINE(
+    keymap_svc, BT_GATT_PRIMARY_SERVICE(BT_UUID_DECLARE_128(ZMK_KEYMAP_PROTOCOL_BT_SERVICE_UUID)),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(ZMK_KEYMAP_PROTOCOL_BT_CHAR_FRAME_UUID),
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT,
+                           keymap_svc_read_response, keymap_svc_write_request, NULL),
+    BT_GATT_CCC(keymap_svc_frame_ccc, BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT));
+
+// A notification can't be longer than the connection's ATT_MTU - 3, and a longer one isn't sent at
+// all, so the response is sent in as many notifications as it takes. Hosts put them back together
+// with the frame's length byte, the same way as on a UART.
+static void keymap_svc_notify_response(struct bt_conn *conn, void *user_data) {
+    const struct bt_gatt_attr *attr = &keymap_svc.attrs[1];
+
+    if (!bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) {
+        return;
+    }
+
+    const size_t chunk_len = bt_gatt_get_mtu(conn) - 3;
+
+    for (size_t offset = 0; offset < response_len; offset += chunk_len) {
+        int err = bt_gatt_notify(conn, attr, response + offset,
+                                 MIN(chunk_len, response_len - offset));
+        if (err) {
+            LOG_WRN("Failed to notify keymap protocol response (err %d)", err);
+            return;
+        }
+    }
+}
+
+static void keymap_svc_request_work_handler(struct k_work *work) {
+    int ret = zmk_keymap_protocol_handle_frame(request, request_len, response, sizeof(response));
+
+    response_len = MAX(ret, 0);
+    atomic_set(&request_pending, false);
+
+    if (ret < 0) {
+        LOG_WRN("Failed to handle keymap protocol request (err %d)", ret);
+        return;
+    }
+
+    bt_conn_foreach(BT_CONN_TYPE_LE, keymap_svc_notify_response, NULL);
+}
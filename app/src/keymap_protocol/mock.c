@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define DT_DRV_COMPAT zmk_keymap_protocol_mock
+
+#include <stdio.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/keymap_protocol.h>
+
+static const uint8_t requests[] = DT_INST_PROP(0, requests);
+static size_t request_offset;
+
+static uint8_t response[ZMK_KEYMAP_PROTOCOL_MAX_FRAME_LEN];
+
+static void keymap_mock_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(keymap_mock_work, keymap_mock_work_handler);
+
+static void keymap_mock_work_handler(struct k_work *work) {
+    const uint8_t *request = &requests[request_offset];
+    size_t request_len = request[0] + 1;
+
+    request_offset += request_len;
+
+    if (request[0] == 0) {
+        LOG_DBG("reloading keymap settings");
+        settings_load_subtree("keymap");
+    } else {
+        int ret = zmk_keymap_protocol_handle_frame(request, request_len, response,
+                                                   sizeof(response));
+        if (ret < 0) {
+            LOG_ERR("Failed to handle keymap protocol request (err %d)", ret);
+        } else {
+            char hex[3 * ZMK_KEYMAP_PROTOCOL_MAX_FRAME_LEN] = {0};
+            size_t hex_len = 0;
+
+            for (int i = 0; i < ret; i++) {
+                hex_len += snprintf(&hex[hex_len], sizeof(hex) - hex_len, i == 0 ? "%02x" : " %02x",
+                                    response[i]);
+            }
+
+            LOG_DBG("response %s", hex);
+        }
+    }
+
+    if (request_offset < sizeof(requests)) {
+        k_work_schedule(&keymap_mock_work, K_MSEC(DT_INST_PROP(0, interval_ms)));
+    }
+}
+
+static int keymap_mock_init(const struct device *_arg) {
+    k_work_schedule(&keymap_mock_work, K_MSEC(DT_INST_PROP(0, interval_ms)));
+
+    return 0;
+}
+
+SYS_INIT(keymap_mock_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/behavior.h>
+#include <zmk/keymap.h>
+#include <zmk/keymap_protocol.h>
+#include <zmk/matrix.h>
+
+// Offsets into a frame, which starts with the length and command bytes.
+#define FRAME_CMD 1
+#define FRAME_PAYLOAD 2
+#define RESP_STATUS 2
+#define RESP_PAYLOAD 3
+
+static int handle_get_info(uint8_t *resp_payload, size_t resp_size) {
+    if (resp_size < 5) {
+        return -ENOMEM;
+    }
+
+    resp_payload[0] = ZMK_KEYMAP_PROTOCOL_VERSION;
+    resp_payload[1] = ZMK_KEYMAP_LAYERS_LEN;
+    sys_put_le16(ZMK_KEYMAP_LEN, &resp_payload[2]);
+    resp_payload[4] = CONFIG_ZMK_KEYMAP_RUNTIME_BEHAVIOR_NAME_MAX_LEN;
+
+    return 5;
+}
+
+static int handle_get_binding(const uint8_t *payload, size_t len, uint8_t *resp_payload,
+                              size_t resp_size) {
+    if (len != 3) {
+        return -EINVAL;
+    }
+
+    const struct zmk_behavior_binding *binding =
+        zmk_keymap_get_layer_binding_at_idx(payload[0], sys_get_le16(&payload[1]));
+    if (!binding) {
+        return -EINVAL;
+    }
+
+    size_t name_len = strlen(binding->behavior_dev);
+    if (resp_size < 8 + name_len) {
+        return -ENOMEM;
+    }
+
+    sys_put_le32(binding->param1, &resp_payload[0]);
+    sys_put_le32(binding->param2, &resp_payload[4]);
+    memcpy(&resp_payload[8], binding->behavior_dev, name_len);
+
+    return 8 + name_len;
+}
+
+static int handle_set_binding(const uint8_t *payload, size_t len) {
+    char behavior_dev[CONFIG_ZMK_KEYMAP_RUNTIME_BEHAVIOR_NAME_MAX_LEN + 1] = {0};
+
+    size_t name_len = len - ZMK_KEYMAP_PROTOCOL_BINDING_HEADER_LEN;
+
+    if (len <= ZMK_KEYMAP_PROTOCOL_BINDING_HEADER_LEN ||
+        name_len > CONFIG_ZMK_KEYMAP_RUNTIME_BEHAVIOR_NAME_MAX_LEN) {
+        return -EINVAL;
+    }
+
+    memcpy(behavior_dev, &payload[ZMK_KEYMAP_PROTOCOL_BINDING_HEADER_LEN], name_len);
+
+    struct zmk_behavior_binding binding = {
+        .behavior_dev = behavior_dev,
+        .param1 = sys_get_le32(&payload[3]),
+        .param2 = sys_get_le32(&payload[7]),
+    };
+
+    return zmk_keymap_set_layer_binding_at_idx(payload[0], sys_get_le16(&payload[1]), binding);
+}
+
+static int handle_reset_binding(const uint8_t *payload, size_t len) {
+    if (len != 3) {
+        return -EINVAL;
+    }
+
+    return zmk_keymap_reset_layer_binding_at_idx(payload[0], sys_get_le16(&payload[1]));
+}
+
+int zmk_keymap_protocol_handle_frame(const uint8_t *req, size_t req_len, uint8_t *resp,
+                                     size_t resp_size) {
+    if (req_len < FRAME_PAYLOAD || req[0] != req_len - 1 || resp_size < RESP_PAYLOAD) {
+        return -EINVAL;
+    }
+
+    const uint8_t *payload = &req[FRAME_PAYLOAD];
+    size_t payload_len = req_len - FRAME_PAYLOAD;
+    uint8_t *resp_payload = &resp[RESP_PAYLOAD];
+    size_t resp_payload_size = resp_size - RESP_PAYLOAD;
+    int ret;
+
+    LOG_DBG("cmd 0x%02X len %d", req[FRAME_CMD], payload_len);
+
+    switch (req[FRAME_CMD]) {
+    case ZMK_KEYMAP_PROTOCOL_CMD_GET_INFO:
+        ret = handle_get_info(resp_payload, resp_payload_size);
+        break;
+    case ZMK_KEYMAP_PROTOCOL_CMD_GET_BINDING:
+        ret = handle_get_binding(payload, payload_len, resp_payload, resp_payload_size);
+        break;
+    case ZMK_KEYMAP_PROTOCOL_CMD_SET_BINDING:
+        ret = handle_set_binding(payload, payload_len);
+        break;
+    case ZMK_KEYMAP_PROTOCOL_CMD_RESET_BINDING:
+        ret = handle_reset_binding(payload, payload_len);
+        break;
+    case ZMK_KEYMAP_PROTOCOL_CMD_SAVE:
+        ret = zmk_keymap_save_changes();
+        break;
+    default:
+        LOG_WRN("Unknown keymap protocol command 0x%02X", req[FRAME_CMD]);
+        ret = -ENOTSUP;
+        break;
+    }
+
+    // Commands that only report success return zero or a positive work queue status, neither of
+    // which carries a payload.
+    size_t resp_payload_len = 0;
+    if (ret > 0 && (req[FRAME_CMD] == ZMK_KEYMAP_PROTOCOL_CMD_GET_INFO ||
+                    req[FRAME_CMD] == ZMK_KEYMAP_PROTOCOL_CMD_GET_BINDING)) {
+        resp_payload_len = ret;
+    }
+
+    resp[0] = RESP_PAYLOAD - 1 + resp_payload_len;
+    resp[FRAME_CMD] = req[FRAME_CMD];
+    resp[RESP_STATUS] = (uint8_t)(int8_t)MIN(ret, 0);
+
+    return RESP_PAYLOAD + resp_payload_len;
+}
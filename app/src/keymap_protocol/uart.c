@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/drivers/uart.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/keymap_protocol.h>
+
+BUILD_ASSERT(DT_HAS_CHOSEN(zmk_keymap_protocol_uart),
+             "CONFIG_ZMK_KEYMAP_PROTOCOL_UART is enabled but no zmk,keymap-protocol-uart chosen "
+             "node was found");
+
+static const struct device *const uart_dev = DEVICE_DT_GET(DT_CHOSEN(zmk_keymap_protocol_uart));
+
+// A gap this long between bytes of a request means the host gave up on it, so the next byte starts
+// a new request.
+#define REQUEST_BYTE_TIMEOUT_MS 100
+
+static uint8_t request[ZMK_KEYMAP_PROTOCOL_MAX_FRAME_LEN];
+static size_t request_len;
+static uint32_t request_last_byte_time;
+
+static uint8_t response[ZMK_KEYMAP_PROTOCOL_MAX_FRAME_LEN];
+
+// Set from when a complete request has been received until its response is sent. Bytes received
+// in the meantime are dropped.
+static atomic_t request_pending;
+
+static void keymap_uart_request_work_handler(struct k_work *work) {
+    int ret = zmk_keymap_protocol_handle_frame(request, request_len, response, sizeof(response));
+
+    request_len = 0;
+
+    if (ret < 0) {
+        LOG_WRN("Failed to handle keymap protocol request (err %d)", ret);
+    }
+
+    for (int i = 0; i < ret; i++) {
+        uart_poll_out(uart_dev, response[i]);
+    }
+
+    atomic_set(&request_pending, false);
+}
+
+static K_WORK_DEFINE(keymap_uart_request_work, keymap_uart_request_work_handler);
+
+static void keymap_uart_isr(const struct device *dev, void *user_data) {
+    while (uart_irq_update(dev) && uart_irq_rx_ready(dev)) {
+        uint8_t byte;
+
+        if (uart_fifo_read(dev, &byte, 1) != 1) {
+            break;
+        }
+
+        if (atomic_get(&request_pending)) {
+            continue;
+        }
+
+        uint32_t now = k_uptime_get_32();
+        if (request_len > 0 && now - request_last_byte_time >= REQUEST_BYTE_TIMEOUT_MS) {
+            LOG_DBG("Dropping incomplete keymap protocol request");
+            request_len = 0;
+        }
+        request_last_byte_time = now;
+
+        // A length byte that can't describe a valid frame means we're out of sync with the host,
+        // so skip it and treat the next byte as the start of a frame.
+        if (request_len == 0 && (byte == 0 || byte >= sizeof(request))) {
+            continue;
+        }
+
+        request[request_len++] = byte;
+
+        if (request_len == request[0] + 1) {
+            atomic_set(&request_pending, true);
+            k_work_submit(&keymap_uart_request_work);
+        }
+    }
+}
+
+static int keymap_uart_init(const struct device *_arg) {
+    if (!device_is_ready(uart_dev)) {
+        LOG_ERR("Keymap protocol UART device is not ready");
+        return -ENODEV;
+    }
+
+    uart_irq_callback_user_data_set(uart_dev, keymap_uart_isr, NULL);
+    uart_irq_rx_enable(uart_dev);
+
+    return 0;
+}
+
+SYS_INIT(keymap_uart_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/activity.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/activity_state_changed.h>
+#include <zmk/events/position_state_changed.h>
+#include <zmk/events/power_level_changed.h>
+#include <zmk/events/sensor_event.h>
+#include <zmk/power_governor.h>
+#include <zmk/power_level.h>
+
+#define ACTIVE_TIMEOUT_MS CONFIG_ZMK_POWER_GOVERNOR_ACTIVE_TIMEOUT
+
+// Key presses and sensor events seen since the last gap longer than ACTIVE_TIMEOUT_MS.
+static uint8_t recent_presses;
+static int64_t level_start_time;
+static struct zmk_power_governor_stats stats;
+
+static void power_governor_set_level(enum zmk_power_level level) {
+    enum zmk_power_level old_level = zmk_power_level_get();
+    if (level == old_level) {
+        return;
+    }
+
+    int64_t now = k_uptime_get();
+
+    stats.level_ms[old_level] += now - level_start_time;
+    stats.transitions++;
+    level_start_time = now;
+
+    LOG_DBG("Power level %d -> %d", old_level, level);
+
+    zmk_power_level_set(level);
+
+    ZMK_EVENT_RAISE(new_zmk_power_level_changed((struct zmk_power_level_changed){.level = level}));
+}
+
+void zmk_power_governor_get_stats(struct zmk_power_governor_stats *out) {
+    *out = stats;
+    out->level_ms[zmk_power_level_get()] += k_uptime_get() - level_start_time;
+}
+
+static void power_governor_timeout_work_cb(struct k_work *work) {
+    recent_presses = 0;
+
+    // Deep idle is only left through activity, so never raise the level here.
+    if (zmk_power_level_get() == ZMK_POWER_LEVEL_ACTIVE) {
+        power_governor_set_level(ZMK_POWER_LEVEL_IDLE);
+    }
+}
+
+static K_WORK_DELAYABLE_DEFINE(power_governor_timeout_work, power_governor_timeout_work_cb);
+
+static void power_governor_activity(void) {
+    recent_presses = MIN(recent_presses + 1, CONFIG_ZMK_POWER_GOVERNOR_ACTIVE_PRESSES);
+
+    // The level rises straight away, but only falls once ACTIVE_TIMEOUT_MS passes with no
+    // presses at all. Needing several presses to reach the active level is the other half of
+    // the hysteresis.
+    enum zmk_power_level level = recent_presses >= CONFIG_ZMK_POWER_GOVERNOR_ACTIVE_PRESSES
+                                     ? ZMK_POWER_LEVEL_ACTIVE
+                                     : ZMK_POWER_LEVEL_IDLE;
+
+    if (level < zmk_power_level_get()) {
+        power_governor_set_level(level);
+    }
+
+    k_work_reschedule(&power_governor_timeout_work, K_MSEC(ACTIVE_TIMEOUT_MS));
+}
+
+static int power_governor_listener(const zmk_event_t *eh) {
+    const struct zmk_position_state_changed *pos_ev = as_zmk_position_state_changed(eh);
+    if (pos_ev != NULL) {
+        if (pos_ev->state) {
+            power_governor_activity();
+        }
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    if (as_zmk_sensor_event(eh) != NULL) {
+        power_governor_activity();
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    if (as_zmk_activity_state_changed(eh) != NULL &&
+        zmk_activity_get_state() != ZMK_ACTIVITY_ACTIVE) {
+        k_work_cancel_delayable(&power_governor_timeout_work);
+        recent_presses = 0;
+        power_governor_set_level(ZMK_POWER_LEVEL_DEEP_IDLE);
+    }
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(power_governor, power_governor_listener);
+ZMK_SUBSCRIPTION(power_governor, zmk_position_state_changed);
+ZMK_SUBSCRIPTION(power_governor, zmk_sensor_event);
+ZMK_SUBSCRIPTION(power_governor, zmk_activity_state_changed);
+
+static int power_governor_init(const struct device *_arg) {
+    level_start_time = k_uptime_get();
+
+    // Start out as if a key was just released, so the keyboard settles to idle on its own.
+    k_work_schedule(&power_governor_timeout_work, K_MSEC(ACTIVE_TIMEOUT_MS));
+
+    return 0;
+}
+
+SYS_INIT(power_governor_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -9,8 +9,8 @@
 #include <zephyr/kernel.h>
 #include <zephyr/settings/settings.h>
 
-#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/logging/log.h>
 
@@ -18,14 +18,32 @@
 #include <drivers/ext_power.h>
 
 #include <zmk/rgb_underglow.h>
+#include <zmk/settings.h>
 
 #include <zmk/activity.h>
 #include <zmk/usb.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/activity_state_changed.h>
 #include <zmk/events/usb_conn_state_changed.h>
+#include <zmk/power_level.h>
 #include <zmk/workqueue.h>
 
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+#include <zmk/battery.h>
+#endif
+
+#if CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_KEY_RATE > 0 || IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+#include <zmk/events/position_state_changed.h>
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+#include <dt-bindings/zmk/matrix_transform.h>
+#include <zmk/keymap.h>
+#include <zmk/matrix.h>
+#include <zmk/matrix_transform.h>
+#include <zmk/events/layer_state_changed.h>
+#endif
+
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if !DT_HAS_CHOSEN(zmk_underglow)
@@ -41,6 +59,18 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #define SAT_MAX 100
 #define BRT_MAX 100
 
+#define HUE_SECTOR (HUE_MAX / 6)
+#define HSB_TO_RGB_SCALE (BRT_MAX * HUE_SECTOR * SAT_MAX)
+
+// Effects advance their animation in steps of this length, whatever the frame rate.
+#define TICK_MS 50
+
+#define KEY_RATE_WINDOW_MS 1000
+
+// How often an unchanged frame is resent, in case the strip lost its state, e.g. because its
+// external power was cycled.
+#define REFRESH_MS 1000
+
 BUILD_ASSERT(CONFIG_ZMK_RGB_UNDERGLOW_BRT_MIN <= CONFIG_ZMK_RGB_UNDERGLOW_BRT_MAX,
              "ERROR: RGB underglow maximum brightness is less than minimum brightness");
 
@@ -49,6 +79,11 @@ enum rgb_underglow_effect {
     UNDERGLOW_EFFECT_BREATHE,
     UNDERGLOW_EFFECT_SPECTRUM,
     UNDERGLOW_EFFECT_SWIRL,
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+    UNDERGLOW_EFFECT_RIPPLE,
+    UNDERGLOW_EFFECT_HEATMAP,
+    UNDERGLOW_EFFECT_LAYER,
+#endif
     UNDERGLOW_EFFECT_NUMBER // Used to track number of underglow effects
 };
 
@@ -64,8 +99,67 @@ static const struct device *led_strip;
 
 static struct led_rgb pixels[STRIP_NUM_PIXELS];
 
+// The frame the effects render into, and whether it differs from what was last sent to the strip.
+static struct led_rgb frame[STRIP_NUM_PIXELS];
+static bool frame_dirty;
+
 static struct rgb_underglow_state state;
 
+static void zmk_rgb_underglow_tick(struct k_work *work);
+
+K_WORK_DELAYABLE_DEFINE(underglow_tick_work, zmk_rgb_underglow_tick);
+
+// When the next frame is due. Animated effects render a frame every frame period, and static ones
+// only when something changes, but never sooner than one frame period after the previous frame.
+static int64_t next_frame_time;
+static bool frame_animating;
+static uint32_t animation_ms;
+static uint32_t frame_cycles;
+
+static struct zmk_rgb_underglow_frame_stats frame_stats;
+
+#if CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_KEY_RATE > 0
+// When each of the most recent key presses happened, oldest first from next_key_press.
+static uint32_t key_press_times[CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_KEY_RATE];
+static uint8_t next_key_press;
+#endif
+
+static void zmk_rgb_underglow_request_frame(void) {
+    if (!state.on) {
+        return;
+    }
+
+    int64_t delay = next_frame_time - k_uptime_get();
+
+    // Doesn't move a frame that is already scheduled, so requests can't speed up animations.
+    k_work_schedule_for_queue(zmk_workqueue_lowprio_work_q(), &underglow_tick_work,
+                              K_MSEC(MAX(delay, 0)));
+}
+
+static void zmk_rgb_underglow_refresh(struct k_work *work) {
+    frame_dirty = true;
+    zmk_rgb_underglow_request_frame();
+}
+
+// Kept apart from underglow_tick_work, so a pending refresh never delays a requested frame.
+K_WORK_DELAYABLE_DEFINE(underglow_refresh_work, zmk_rgb_underglow_refresh);
+
+static bool zmk_rgb_underglow_throttled(int64_t now) {
+#if CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_KEY_RATE > 0
+    if ((uint32_t)now - key_press_times[next_key_press] < KEY_RATE_WINDOW_MS) {
+        return true;
+    }
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING) && CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_BATTERY_LEVEL > 0
+    if (zmk_battery_state_of_charge() < CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_BATTERY_LEVEL) {
+        return true;
+    }
+#endif
+
+    return false;
+}
+
 #if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_EXT_POWER)
 static const struct device *const ext_power = DEVICE_DT_GET(DT_INST(0, zmk_ext_power_generic));
 #endif
@@ -81,18 +175,22 @@ static struct zmk_led_hsb hsb_scale_zero_max(struct zmk_led_hsb hsb) {
     return hsb;
 }
 
+// Converts using integer arithmetic only, since many of the supported MCUs have no FPU. Every
+// input is a small integer, so each channel is computed exactly as a single fraction and then
+// truncated, matching the result of the equivalent floating point formula.
 static struct led_rgb hsb_to_rgb(struct zmk_led_hsb hsb) {
-    float r, g, b;
-
-    uint8_t i = hsb.h / 60;
-    float v = hsb.b / ((float)BRT_MAX);
-    float s = hsb.s / ((float)SAT_MAX);
-    float f = hsb.h / ((float)HUE_MAX) * 6 - i;
-    float p = v * (1 - s);
-    float q = v * (1 - f * s);
-    float t = v * (1 - (1 - f) * s);
-
-    switch (i % 6) {
+    uint16_t h = hsb.h % HUE_MAX;
+    uint32_t i = h / HUE_SECTOR;
+    uint32_t f = h % HUE_SECTOR;
+
+    // Each channel is v * (1 - x * s), scaled by 255 * BRT_MAX * HUE_SECTOR * SAT_MAX.
+    uint32_t v = 255 * hsb.b * HUE_SECTOR * SAT_MAX;
+    uint32_t p = 255 * hsb.b * (HUE_SECTOR * SAT_MAX - HUE_SECTOR * hsb.s);
+    uint32_t q = 255 * hsb.b * (HUE_SECTOR * SAT_MAX - f * hsb.s);
+    uint32_t t = 255 * hsb.b * (HUE_SECTOR * SAT_MAX - (HUE_SECTOR - f) * hsb.s);
+    uint32_t r, g, b;
+
+    switch (i) {
     case 0:
         r = v;
         g = t;
@@ -118,96 +216,468 @@ static struct led_rgb hsb_to_rgb(struct zmk_led_hsb hsb) {
         g = p;
         b = v;
         break;
-    case 5:
+    default:
         r = v;
         g = p;
         b = q;
         break;
     }
 
-    struct led_rgb rgb = {r : r * 255, g : g * 255, b : b * 255};
+    struct led_rgb rgb = {
+        r : r / HSB_TO_RGB_SCALE,
+        g : g / HSB_TO_RGB_SCALE,
+        b : b / HSB_TO_RGB_SCALE,
+    };
 
     return rgb;
 }
 
-static void zmk_rgb_underglow_effect_solid(void) {
-    for (int i = 0; i < STRIP_NUM_PIXELS; i++) {
-        pixels[i] = hsb_to_rgb(hsb_scale_min_max(state.color));
+static void zmk_rgb_underglow_set_pixel(int i, struct led_rgb rgb) {
+    if (frame[i].r != rgb.r || frame[i].g != rgb.g || frame[i].b != rgb.b) {
+        frame[i] = rgb;
+        frame_dirty = true;
     }
 }
 
-static void zmk_rgb_underglow_effect_breathe(void) {
+static void zmk_rgb_underglow_fill(struct led_rgb rgb) {
     for (int i = 0; i < STRIP_NUM_PIXELS; i++) {
-        struct zmk_led_hsb hsb = state.color;
-        hsb.b = abs(state.animation_step - 1200) / 12;
-
-        pixels[i] = hsb_to_rgb(hsb_scale_zero_max(hsb));
+        zmk_rgb_underglow_set_pixel(i, rgb);
     }
+}
 
-    state.animation_step += state.animation_speed * 10;
+// Each effect renders the current frame after advancing its animation by the given number of
+// animation steps, and returns whether it is animated and needs further frames.
+
+static bool zmk_rgb_underglow_effect_solid(uint16_t ticks) {
+    zmk_rgb_underglow_fill(hsb_to_rgb(hsb_scale_min_max(state.color)));
+
+    return false;
+}
+
+static bool zmk_rgb_underglow_effect_breathe(uint16_t ticks) {
+    state.animation_step += state.animation_speed * 10 * ticks;
 
     if (state.animation_step > 2400) {
         state.animation_step = 0;
     }
-}
 
-static void zmk_rgb_underglow_effect_spectrum(void) {
-    for (int i = 0; i < STRIP_NUM_PIXELS; i++) {
-        struct zmk_led_hsb hsb = state.color;
-        hsb.h = state.animation_step;
+    struct zmk_led_hsb hsb = state.color;
+    hsb.b = abs(state.animation_step - 1200) / 12;
 
-        pixels[i] = hsb_to_rgb(hsb_scale_min_max(hsb));
-    }
+    zmk_rgb_underglow_fill(hsb_to_rgb(hsb_scale_zero_max(hsb)));
 
-    state.animation_step += state.animation_speed;
+    return true;
+}
+
+static bool zmk_rgb_underglow_effect_spectrum(uint16_t ticks) {
+    state.animation_step += state.animation_speed * ticks;
     state.animation_step = state.animation_step % HUE_MAX;
+
+    struct zmk_led_hsb hsb = state.color;
+    hsb.h = state.animation_step;
+
+    zmk_rgb_underglow_fill(hsb_to_rgb(hsb_scale_min_max(hsb)));
+
+    return true;
 }
 
-static void zmk_rgb_underglow_effect_swirl(void) {
+static bool zmk_rgb_underglow_effect_swirl(uint16_t ticks) {
+    state.animation_step += state.animation_speed * 2 * ticks;
+    state.animation_step = state.animation_step % HUE_MAX;
+
     for (int i = 0; i < STRIP_NUM_PIXELS; i++) {
         struct zmk_led_hsb hsb = state.color;
         hsb.h = (HUE_MAX / STRIP_NUM_PIXELS * i + state.animation_step) % HUE_MAX;
 
-        pixels[i] = hsb_to_rgb(hsb_scale_min_max(hsb));
+        zmk_rgb_underglow_set_pixel(i, hsb_to_rgb(hsb_scale_min_max(hsb)));
     }
 
-    state.animation_step += state.animation_speed * 2;
-    state.animation_step = state.animation_step % HUE_MAX;
+    return true;
 }
 
-static void zmk_rgb_underglow_tick(struct k_work *work) {
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+
+#if !DT_HAS_CHOSEN(zmk_underglow_key_leds)
+
+#error "A zmk,underglow-key-leds chosen node must be declared"
+
+#endif
+
+#define KEY_LEDS_CHOSEN DT_CHOSEN(zmk_underglow_key_leds)
+#define KEY_LEDS_LEN DT_PROP_LEN(KEY_LEDS_CHOSEN, leds)
+
+BUILD_ASSERT(KEY_LEDS_LEN <= STRIP_NUM_PIXELS,
+             "ERROR: RGB underglow key LEDs list more LEDs than the strip has");
+
+#define PRESS_QUEUE_LEN 16
+#define HEATMAP_HUE_COLD 240
+#define HEATMAP_STEP 32
+
+// Ripple radii and distances between LEDs are measured in quarters of a matrix cell.
+#define RIPPLE_UNIT 4
+#define RIPPLE_MAX_RADIUS (RIPPLE_UNIT * (MAX(ZMK_MATRIX_ROWS, ZMK_MATRIX_COLS) + 1) * 3 / 2)
+
+#define KEY_LED_CELL(i, _) DT_PROP_BY_IDX(KEY_LEDS_CHOSEN, leds, i)
+
+static const uint16_t key_led_cells[] = {LISTIFY(KEY_LEDS_LEN, KEY_LED_CELL, (, ))};
+
+// The keymap position of each LED, or a negative value if there is no key at the LED.
+static int16_t led_positions[KEY_LEDS_LEN];
+
+// The LED of each keymap position, offset by one so that 0 means the key has no LED.
+static uint16_t position_leds[ZMK_KEYMAP_LEN];
+
+// How lit up each LED is. Key presses raise the level of their LED, and every frame decays it.
+static uint8_t led_levels[STRIP_NUM_PIXELS];
+
+struct ripple {
+    uint8_t row;
+    uint8_t col;
+    uint16_t radius;
+    bool active;
+};
+
+static struct ripple ripples[CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY_RIPPLES];
+static uint8_t next_ripple;
+
+// Key presses are queued by the listener and consumed when a frame starts rendering, so the key
+// event path never waits on the renderer.
+K_MSGQ_DEFINE(underglow_key_presses, sizeof(uint16_t), PRESS_QUEUE_LEN, 2);
+
+// The next LED to render. Frames that don't fit in the frame budget are finished in later runs.
+static uint16_t per_key_cursor;
+
+static zmk_keymap_layers_state_t per_key_layer_state;
+static uint16_t per_key_ticks;
+static bool per_key_animating;
+
+static void zmk_rgb_underglow_per_key_init(void) {
+    for (int i = 0; i < KEY_LEDS_LEN; i++) {
+        int32_t position = zmk_matrix_transform_row_column_to_position(
+            KT_ROW(key_led_cells[i]), KT_COL(key_led_cells[i]));
+
+        if (position < 0 || position >= ZMK_KEYMAP_LEN) {
+            led_positions[i] = -1;
+            continue;
+        }
+
+        led_positions[i] = position;
+        position_leds[position] = i + 1;
+    }
+}
+
+static void zmk_rgb_underglow_per_key_press(uint16_t led) {
     switch (state.current_effect) {
-    case UNDERGLOW_EFFECT_SOLID:
-        zmk_rgb_underglow_effect_solid();
+    case UNDERGLOW_EFFECT_RIPPLE:
+        led_levels[led] = UINT8_MAX;
+
+        if (led < KEY_LEDS_LEN) {
+            ripples[next_ripple] = (struct ripple){
+                row : KT_ROW(key_led_cells[led]),
+                col : KT_COL(key_led_cells[led]),
+                radius : 0,
+                active : true,
+            };
+            next_ripple = (next_ripple + 1) % ARRAY_SIZE(ripples);
+        }
         break;
-    case UNDERGLOW_EFFECT_BREATHE:
-        zmk_rgb_underglow_effect_breathe();
+    case UNDERGLOW_EFFECT_HEATMAP:
+        led_levels[led] = MIN(led_levels[led] + HEATMAP_STEP, UINT8_MAX);
         break;
-    case UNDERGLOW_EFFECT_SPECTRUM:
-        zmk_rgb_underglow_effect_spectrum();
-        break;
-    case UNDERGLOW_EFFECT_SWIRL:
-        zmk_rgb_underglow_effect_swirl();
+    default:
+        led_levels[led] = UINT8_MAX;
         break;
     }
+}
+
+static void zmk_rgb_underglow_per_key_begin_frame(uint16_t ticks) {
+    uint16_t led;
+
+    per_key_ticks = ticks;
+    per_key_animating = false;
+
+    while (k_msgq_get(&underglow_key_presses, &led, K_NO_WAIT) == 0) {
+        zmk_rgb_underglow_per_key_press(led);
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(ripples); i++) {
+        if (!ripples[i].active) {
+            continue;
+        }
+
+        ripples[i].radius += state.animation_speed * ticks;
+        if (ripples[i].radius > RIPPLE_MAX_RADIUS) {
+            ripples[i].active = false;
+        } else {
+            per_key_animating = true;
+        }
+    }
+
+    per_key_layer_state = zmk_keymap_layer_state();
+    zmk_keymap_layers_state_write(&per_key_layer_state, zmk_keymap_layer_default(), true);
+}
+
+static bool zmk_rgb_underglow_ripple_hits(const struct ripple *ripple, uint16_t cell) {
+    int dr = abs(KT_ROW(cell) - ripple->row);
+    int dc = abs(KT_COL(cell) - ripple->col);
+
+    // Cheap approximation of the euclidean distance, good enough for a ring of light.
+    int distance = RIPPLE_UNIT * MAX(dr, dc) + RIPPLE_UNIT / 2 * MIN(dr, dc);
+
+    return ripple->active && abs(distance - ripple->radius) < RIPPLE_UNIT;
+}
+
+static uint8_t zmk_rgb_underglow_per_key_level(int led) {
+    uint32_t decay = (state.current_effect == UNDERGLOW_EFFECT_HEATMAP ? 1 : 32) * per_key_ticks;
+    uint8_t level = led_levels[led] > decay ? led_levels[led] - decay : 0;
+
+    if (state.current_effect == UNDERGLOW_EFFECT_RIPPLE && led < KEY_LEDS_LEN) {
+        for (int i = 0; i < ARRAY_SIZE(ripples); i++) {
+            if (zmk_rgb_underglow_ripple_hits(&ripples[i], key_led_cells[led])) {
+                level = UINT8_MAX;
+                break;
+            }
+        }
+    }
+
+    led_levels[led] = level;
+    per_key_animating |= level > 0;
+
+    return level;
+}
+
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_transparent)
+#define TRANSPARENT_BEHAVIOR_NAME DEVICE_DT_NAME(DT_INST(0, zmk_behavior_transparent))
+#endif
+
+// Returns the layer the binding of the key at the LED comes from.
+static uint8_t zmk_rgb_underglow_per_key_layer(int led) {
+    int position = led < KEY_LEDS_LEN ? led_positions[led] : -1;
+    int layer;
+
+    ZMK_KEYMAP_LAYERS_STATE_FOREACH_DESC(&per_key_layer_state, layer) {
+        if (position < 0) {
+            break;
+        }
+
+#ifdef TRANSPARENT_BEHAVIOR_NAME
+        const struct zmk_behavior_binding *binding =
+            zmk_keymap_get_layer_binding_at_idx(layer, position);
+
+        if (binding->behavior_dev != NULL &&
+            strcmp(binding->behavior_dev, TRANSPARENT_BEHAVIOR_NAME) == 0) {
+            continue;
+        }
+#endif
+
+        return layer;
+    }
+
+    return zmk_keymap_highest_layer_active();
+}
+
+static struct led_rgb zmk_rgb_underglow_per_key_pixel(int led) {
+    struct zmk_led_hsb hsb = state.color;
+    uint8_t level = zmk_rgb_underglow_per_key_level(led);
+
+    switch (state.current_effect) {
+    case UNDERGLOW_EFFECT_RIPPLE:
+        hsb.b = hsb.b * level / UINT8_MAX;
+        return hsb_to_rgb(hsb_scale_zero_max(hsb));
+    case UNDERGLOW_EFFECT_HEATMAP:
+        hsb.h = HEATMAP_HUE_COLD - HEATMAP_HUE_COLD * level / UINT8_MAX;
+        return hsb_to_rgb(hsb_scale_min_max(hsb));
+    default:
+        // Each layer gets its own hue, and pressed keys flash towards white.
+        hsb.h = (hsb.h + zmk_rgb_underglow_per_key_layer(led) * HUE_MAX / ZMK_KEYMAP_LAYERS_LEN) %
+                HUE_MAX;
+        hsb.s -= hsb.s * level / UINT8_MAX;
+        return hsb_to_rgb(hsb_scale_min_max(hsb));
+    }
+}
+
+// Renders as much of the frame as fits in the frame budget. per_key_cursor is left non-zero if the
+// frame isn't finished yet.
+static bool zmk_rgb_underglow_effect_per_key(uint16_t ticks) {
+    uint32_t start = k_cycle_get_32();
+
+    if (per_key_cursor == 0) {
+        zmk_rgb_underglow_per_key_begin_frame(ticks);
+    }
+
+    while (per_key_cursor < STRIP_NUM_PIXELS) {
+        int led = per_key_cursor++;
+
+        zmk_rgb_underglow_set_pixel(led, zmk_rgb_underglow_per_key_pixel(led));
+
+        if (per_key_cursor < STRIP_NUM_PIXELS &&
+            k_cyc_to_us_floor32(k_cycle_get_32() - start) >=
+                CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY_FRAME_BUDGET_US) {
+            return true;
+        }
+    }
+
+    per_key_cursor = 0;
 
-    int err = led_strip_update_rgb(led_strip, pixels, STRIP_NUM_PIXELS);
-    if (err < 0) {
-        LOG_ERR("Failed to update the RGB strip (%d)", err);
+    return per_key_animating;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY) */
+
+static bool zmk_rgb_underglow_render(uint16_t ticks) {
+    switch (state.current_effect) {
+    case UNDERGLOW_EFFECT_SOLID:
+        return zmk_rgb_underglow_effect_solid(ticks);
+    case UNDERGLOW_EFFECT_BREATHE:
+        return zmk_rgb_underglow_effect_breathe(ticks);
+    case UNDERGLOW_EFFECT_SPECTRUM:
+        return zmk_rgb_underglow_effect_spectrum(ticks);
+    case UNDERGLOW_EFFECT_SWIRL:
+        return zmk_rgb_underglow_effect_swirl(ticks);
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+    case UNDERGLOW_EFFECT_RIPPLE:
+    case UNDERGLOW_EFFECT_HEATMAP:
+    case UNDERGLOW_EFFECT_LAYER:
+        return zmk_rgb_underglow_effect_per_key(ticks);
+#endif
+    default:
+        return false;
     }
 }
 
-K_WORK_DEFINE(underglow_tick_work, zmk_rgb_underglow_tick);
+static void zmk_rgb_underglow_tick(struct k_work *work) {
+    uint32_t start = k_cycle_get_32();
+    int64_t now = k_uptime_get();
+    uint16_t ticks = 0;
 
-static void zmk_rgb_underglow_tick_handler(struct k_timer *timer) {
     if (!state.on) {
         return;
     }
 
-    k_work_submit_to_queue(zmk_workqueue_lowprio_work_q(), &underglow_tick_work);
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+    bool frame_started = per_key_cursor == 0;
+#else
+    bool frame_started = true;
+#endif
+
+    if (frame_started) {
+        bool throttled = zmk_rgb_underglow_throttled(now);
+        uint32_t period = zmk_power_level_scale_ms(
+            1000 / (throttled ? CONFIG_ZMK_RGB_UNDERGLOW_THROTTLED_FPS
+                              : CONFIG_ZMK_RGB_UNDERGLOW_FPS));
+        uint32_t frames = 1;
+
+        if (frame_animating) {
+            // Frames whose time passed while an earlier frame was still rendering or being pushed
+            // to the strip are dropped rather than rendered back to back. The animation still
+            // advances by their time, so it keeps its speed.
+            if (now > next_frame_time) {
+                frames += (now - next_frame_time) / period;
+            }
+
+            frame_stats.skipped += frames - 1;
+            animation_ms += period * frames;
+            next_frame_time += period * frames;
+        } else {
+            next_frame_time = now + period;
+        }
+
+        ticks = animation_ms / TICK_MS;
+        animation_ms %= TICK_MS;
+
+        frame_cycles = 0;
+        frame_stats.frames++;
+        frame_stats.throttled += throttled;
+    }
+
+    frame_animating = zmk_rgb_underglow_render(ticks);
+
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+    if (per_key_cursor != 0) {
+        // Let other low priority work run before rendering the rest of the frame.
+        frame_cycles += k_cycle_get_32() - start;
+        k_work_reschedule_for_queue(zmk_workqueue_lowprio_work_q(), &underglow_tick_work,
+                                    K_NO_WAIT);
+        return;
+    }
+#endif
+
+    if (frame_dirty) {
+        frame_dirty = false;
+        frame_stats.updates++;
+
+        // The driver may overwrite the buffer it is given, so it gets a copy of the frame.
+        memcpy(pixels, frame, sizeof(pixels));
+
+        int err = led_strip_update_rgb(led_strip, pixels, STRIP_NUM_PIXELS);
+        if (err < 0) {
+            LOG_ERR("Failed to update the RGB strip (%d)", err);
+        }
+    }
+
+    frame_cycles += k_cycle_get_32() - start;
+    frame_stats.last_frame_us = k_cyc_to_us_floor32(frame_cycles);
+    frame_stats.max_frame_us = MAX(frame_stats.max_frame_us, frame_stats.last_frame_us);
+
+    if (frame_animating) {
+        zmk_rgb_underglow_request_frame();
+    } else {
+        k_work_reschedule_for_queue(zmk_workqueue_lowprio_work_q(), &underglow_refresh_work,
+                                    K_MSEC(zmk_power_level_scale_ms(REFRESH_MS)));
+    }
 }
 
-K_TIMER_DEFINE(underglow_tick, zmk_rgb_underglow_tick_handler, NULL);
+#if CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_KEY_RATE > 0 || IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+static int rgb_underglow_key_listener(const zmk_event_t *eh) {
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+    if (as_zmk_layer_state_changed(eh)) {
+        if (state.current_effect == UNDERGLOW_EFFECT_LAYER) {
+            zmk_rgb_underglow_request_frame();
+        }
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+#endif
+
+    const struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
+    if (ev == NULL || !ev->state) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+#if CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_KEY_RATE > 0
+    key_press_times[next_key_press] = k_uptime_get_32();
+    next_key_press = (next_key_press + 1) % ARRAY_SIZE(key_press_times);
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+    if (!state.on || state.current_effect < UNDERGLOW_EFFECT_RIPPLE ||
+        ev->position >= ZMK_KEYMAP_LEN || !position_leds[ev->position]) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    uint16_t led = position_leds[ev->position] - 1;
+
+    // If the renderer has fallen this far behind, dropping a press only loses a bit of light.
+    k_msgq_put(&underglow_key_presses, &led, K_NO_WAIT);
+    zmk_rgb_underglow_request_frame();
+#endif
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(rgb_underglow_key, rgb_underglow_key_listener);
+ZMK_SUBSCRIPTION(rgb_underglow_key, zmk_position_state_changed);
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+ZMK_SUBSCRIPTION(rgb_underglow_key, zmk_layer_state_changed);
+#endif
+#endif
+
+int zmk_rgb_underglow_get_frame_stats(struct zmk_rgb_underglow_frame_stats *stats) {
+    if (!led_strip)
+        return -ENODEV;
+
+    *stats = frame_stats;
+    return 0;
+}
 
 #if IS_ENABLED(CONFIG_SETTINGS)
 static int rgb_settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg) {
@@ -232,16 +702,20 @@ static int rgb_settings_set(const char *name, size_t len, settings_read_cb read_
 
 struct settings_handler rgb_conf = {.name = "rgb/underglow", .h_set = rgb_settings_set};
 
-static void zmk_rgb_underglow_save_state_work(struct k_work *_work) {
-    settings_save_one("rgb/underglow/state", &state, sizeof(state));
+static void zmk_rgb_underglow_write_state(void) {
+    zmk_settings_save_one("rgb/underglow/state", &state, sizeof(state));
 }
 
-static struct k_work_delayable underglow_save_work;
+ZMK_SETTINGS_SAVER_DEFINE(underglow_saver, zmk_rgb_underglow_write_state);
 #endif
 
 static int zmk_rgb_underglow_init(const struct device *_arg) {
     led_strip = DEVICE_DT_GET(STRIP_CHOSEN);
 
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+    zmk_rgb_underglow_per_key_init();
+#endif
+
 #if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_EXT_POWER)
     if (!device_is_ready(ext_power)) {
         LOG_ERR("External power device \"%s\" is not ready", ext_power->name);
@@ -261,6 +735,13 @@ static int zmk_rgb_underglow_init(const struct device *_arg) {
         on : IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_ON_START)
     };
 
+#if CONFIG_ZMK_RGB_UNDERGLOW_THROTTLE_KEY_RATE > 0
+    // Start with a history that is already outside the window, so boot doesn't look like typing.
+    for (int i = 0; i < ARRAY_SIZE(key_press_times); i++) {
+        key_press_times[i] = k_uptime_get_32() - KEY_RATE_WINDOW_MS;
+    }
+#endif
+
 #if IS_ENABLED(CONFIG_SETTINGS)
     settings_subsys_init();
 
@@ -270,8 +751,6 @@ static int zmk_rgb_underglow_init(const struct device *_arg) {
         return err;
     }
 
-    k_work_init_delayable(&underglow_save_work, zmk_rgb_underglow_save_state_work);
-
     settings_load_subtree("rgb/underglow");
 #endif
 
@@ -279,17 +758,14 @@ static int zmk_rgb_underglow_init(const struct device *_arg) {
     state.on = zmk_usb_is_powered();
 #endif
 
-    if (state.on) {
-        k_timer_start(&underglow_tick, K_NO_WAIT, K_MSEC(50));
-    }
+    zmk_rgb_underglow_request_frame();
 
     return 0;
 }
 
 int zmk_rgb_underglow_save_state(void) {
 #if IS_ENABLED(CONFIG_SETTINGS)
-    int ret = k_work_reschedule(&underglow_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
-    return MIN(ret, 0);
+    return zmk_settings_save_request(&underglow_saver);
 #else
     return 0;
 #endif
@@ -318,14 +794,17 @@ int zmk_rgb_underglow_on(void) {
 
     state.on = true;
     state.animation_step = 0;
-    k_timer_start(&underglow_tick, K_NO_WAIT, K_MSEC(50));
+    frame_dirty = true;
+    frame_animating = false;
+    zmk_rgb_underglow_request_frame();
 
     return zmk_rgb_underglow_save_state();
 }
 
 static void zmk_rgb_underglow_off_handler(struct k_work *work) {
     for (int i = 0; i < STRIP_NUM_PIXELS; i++) {
-        pixels[i] = (struct led_rgb){r : 0, g : 0, b : 0};
+        frame[i] = (struct led_rgb){r : 0, g : 0, b : 0};
+        pixels[i] = frame[i];
     }
 
     led_strip_update_rgb(led_strip, pixels, STRIP_NUM_PIXELS);
@@ -348,7 +827,8 @@ int zmk_rgb_underglow_off(void) {
 
     k_work_submit_to_queue(zmk_workqueue_lowprio_work_q(), &underglow_off_work);
 
-    k_timer_stop(&underglow_tick);
+    k_work_cancel_delayable(&underglow_tick_work);
+    k_work_cancel_delayable(&underglow_refresh_work);
     state.on = false;
 
     return zmk_rgb_underglow_save_state();
@@ -369,6 +849,13 @@ int zmk_rgb_underglow_select_effect(int effect) {
     state.current_effect = effect;
     state.animation_step = 0;
 
+#if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_PER_KEY)
+    per_key_cursor = 0;
+    memset(led_levels, 0, sizeof(led_levels));
+#endif
+
+    zmk_rgb_underglow_request_frame();
+
     return zmk_rgb_underglow_save_state();
 }
 
@@ -386,6 +873,7 @@ int zmk_rgb_underglow_set_hsb(struct zmk_led_hsb color) {
     }
 
     state.color = color;
+    zmk_rgb_underglow_request_frame();
 
     return 0;
 }
@@ -427,6 +915,7 @@ int zmk_rgb_underglow_change_hue(int direction) {
         return -ENODEV;
 
     state.color = zmk_rgb_underglow_calc_hue(direction);
+    zmk_rgb_underglow_request_frame();
 
     return zmk_rgb_underglow_save_state();
 }
@@ -436,6 +925,7 @@ int zmk_rgb_underglow_change_sat(int direction) {
         return -ENODEV;
 
     state.color = zmk_rgb_underglow_calc_sat(direction);
+    zmk_rgb_underglow_request_frame();
 
     return zmk_rgb_underglow_save_state();
 }
@@ -445,6 +935,7 @@ int zmk_rgb_underglow_change_brt(int direction) {
         return -ENODEV;
 
     state.color = zmk_rgb_underglow_calc_brt(direction);
+    zmk_rgb_underglow_request_frame();
 
     return zmk_rgb_underglow_save_state();
 }
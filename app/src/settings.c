@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/spinlock.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/settings.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/position_state_changed.h>
+
+static sys_slist_t pending_savers = SYS_SLIST_STATIC_INIT(&pending_savers);
+static struct k_spinlock pending_savers_lock;
+
+static struct zmk_settings_save_stats stats;
+
+// Key activity used to decide whether writing now would stall key processing.
+static atomic_t pressed_key_count;
+static int64_t last_key_activity;
+
+// When the current batch was first postponed for key activity, or 0 if it hasn't been.
+static int64_t deferred_since;
+static bool force_commit;
+
+static void settings_commit_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(settings_commit_work, settings_commit_work_handler);
+
+static bool should_defer_commit(int64_t now) {
+    if (force_commit) {
+        return false;
+    }
+
+    if (atomic_get(&pressed_key_count) == 0 &&
+        now - last_key_activity >= CONFIG_ZMK_SETTINGS_SAVE_KEY_IDLE_MS) {
+        return false;
+    }
+
+    // Don't let constant typing keep changes from ever being written.
+    return deferred_since == 0 || now - deferred_since < CONFIG_ZMK_SETTINGS_SAVE_MAX_DEFER;
+}
+
+static void settings_commit_work_handler(struct k_work *work) {
+    int64_t now = k_uptime_get();
+
+    if (should_defer_commit(now)) {
+        if (deferred_since == 0) {
+            deferred_since = now;
+        }
+
+        stats.deferrals++;
+        k_work_reschedule(&settings_commit_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_KEY_IDLE_MS));
+        return;
+    }
+
+    deferred_since = 0;
+    force_commit = false;
+
+    uint32_t entries = stats.entries;
+    uint32_t bytes = stats.bytes;
+
+    while (true) {
+        k_spinlock_key_t key = k_spin_lock(&pending_savers_lock);
+        sys_snode_t *node = sys_slist_get(&pending_savers);
+        k_spin_unlock(&pending_savers_lock, key);
+
+        if (!node) {
+            break;
+        }
+
+        struct zmk_settings_saver *saver = CONTAINER_OF(node, struct zmk_settings_saver, node);
+
+        // Clear before saving, so changes made while saving are picked up by the next batch.
+        atomic_set(&saver->pending, false);
+
+        LOG_DBG("Saving %s", saver->name);
+        saver->save();
+    }
+
+    stats.commits++;
+
+    LOG_DBG("Wrote %d settings values (%d bytes), %d batches so far", stats.entries - entries,
+            stats.bytes - bytes, stats.commits);
+}
+
+int zmk_settings_save_request(struct zmk_settings_saver *saver) {
+    if (!atomic_set(&saver->pending, true)) {
+        k_spinlock_key_t key = k_spin_lock(&pending_savers_lock);
+        sys_slist_append(&pending_savers, &saver->node);
+        k_spin_unlock(&pending_savers_lock, key);
+    }
+
+    int ret = k_work_reschedule(&settings_commit_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+    return MIN(ret, 0);
+}
+
+int zmk_settings_save_now(void) {
+    force_commit = true;
+
+    int ret = k_work_reschedule(&settings_commit_work, K_NO_WAIT);
+    return MIN(ret, 0);
+}
+
+int zmk_settings_save_one(const char *name, const void *value, size_t len) {
+    int err = settings_save_one(name, value, len);
+    if (err) {
+        LOG_ERR("Failed to save %s (err %d)", name, err);
+        return err;
+    }
+
+    stats.entries++;
+    stats.bytes += len;
+
+    return 0;
+}
+
+int zmk_settings_delete(const char *name) {
+    int err = settings_delete(name);
+    if (err) {
+        LOG_ERR("Failed to delete %s (err %d)", name, err);
+        return err;
+    }
+
+    stats.entries++;
+
+    return 0;
+}
+
+void zmk_settings_save_get_stats(struct zmk_settings_save_stats *out) { *out = stats; }
+
+static int settings_position_state_changed_listener(const zmk_event_t *eh) {
+    const struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
+
+    if (ev->state) {
+        atomic_inc(&pressed_key_count);
+    } else if (atomic_get(&pressed_key_count) > 0) {
+        atomic_dec(&pressed_key_count);
+    }
+
+    last_key_activity = ev->timestamp;
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(settings_save, settings_position_state_changed_listener);
+ZMK_SUBSCRIPTION(settings_save, zmk_position_state_changed);
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+// A settings backend which only keeps values in RAM, so native_posix tests can save and load
+// settings without depending on a flash file left over from a previous run.
+
+#define SETTINGS_RAM_ENTRIES 32
+#define SETTINGS_RAM_MAX_VALUE_LEN 64
+
+struct settings_ram_entry {
+    char name[SETTINGS_MAX_NAME_LEN + 1];
+    uint8_t value[SETTINGS_RAM_MAX_VALUE_LEN];
+    // Zero for an unused entry, since saving an empty value deletes it.
+    size_t len;
+};
+
+static struct settings_ram_entry entries[SETTINGS_RAM_ENTRIES];
+
+static ssize_t settings_ram_read_cb(void *cb_arg, void *data, size_t len) {
+    const struct settings_ram_entry *entry = cb_arg;
+    size_t read_len = MIN(len, entry->len);
+
+    memcpy(data, entry->value, read_len);
+
+    return read_len;
+}
+
+static int settings_ram_load(struct settings_store *cs, const struct settings_load_arg *arg) {
+    for (int i = 0; i < SETTINGS_RAM_ENTRIES; i++) {
+        struct settings_ram_entry *entry = &entries[i];
+
+        if (entry->len > 0) {
+            settings_call_set_handler(entry->name, entry->len, settings_ram_read_cb, entry, arg);
+        }
+    }
+
+    return 0;
+}
+
+static int settings_ram_save(struct settings_store *cs, const char *name, const char *value,
+                             size_t val_len) {
+    struct settings_ram_entry *entry = NULL;
+    struct settings_ram_entry *unused = NULL;
+
+    if (strlen(name) > SETTINGS_MAX_NAME_LEN) {
+        return -ENAMETOOLONG;
+    }
+
+    if (val_len > SETTINGS_RAM_MAX_VALUE_LEN) {
+        return -ENOMEM;
+    }
+
+    for (int i = 0; i < SETTINGS_RAM_ENTRIES; i++) {
+        if (entries[i].len == 0) {
+            unused = unused ? unused : &entries[i];
+        } else if (strcmp(entries[i].name, name) == 0) {
+            entry = &entries[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        if (val_len == 0) {
+            return 0;
+        }
+
+        if (!unused) {
+            LOG_ERR("No room to save %s", name);
+            return -ENOMEM;
+        }
+
+        entry = unused;
+        strcpy(entry->name, name);
+    }
+
+    memcpy(entry->value, value, val_len);
+    entry->len = val_len;
+
+    return 0;
+}
+
+static const struct settings_store_itf settings_ram_itf = {
+    .csi_load = settings_ram_load,
+    .csi_save = settings_ram_save,
+};
+
+static struct settings_store settings_ram_store = {.cs_itf = &settings_ram_itf};
+
+int settings_backend_init(void) {
+    settings_src_register(&settings_ram_store);
+    settings_dst_register(&settings_ram_store);
+
+    return 0;
+}
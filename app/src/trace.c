@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+#if IS_ENABLED(CONFIG_ZMK_TRACE_UART)
+#include <zephyr/drivers/uart.h>
+#endif
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <dt-bindings/zmk/hid_usage_pages.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/keycode_state_changed.h>
+#include <zmk/events/position_state_changed.h>
+#include <zmk/keymap.h>
+#include <zmk/trace.h>
+#include <zmk/workqueue.h>
+
+#if IS_ENABLED(CONFIG_ZMK_TRACE_UART)
+
+BUILD_ASSERT(DT_HAS_CHOSEN(zmk_trace_uart),
+             "CONFIG_ZMK_TRACE_UART is enabled but no zmk,trace-uart chosen node was found");
+
+static const struct device *const uart_dev = DEVICE_DT_GET(DT_CHOSEN(zmk_trace_uart));
+
+#endif /* IS_ENABLED(CONFIG_ZMK_TRACE_UART) */
+
+// Records are written at index head and sent from index tail. Both only ever increase, so the
+// number of buffered records is their difference.
+static struct zmk_trace_record records[CONFIG_ZMK_TRACE_BUFFER_SIZE];
+static uint32_t records_head;
+static uint32_t records_tail;
+static uint32_t records_dropped;
+static struct k_spinlock records_lock;
+
+static void trace_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(trace_work, trace_work_handler);
+
+static inline const char *type_str(uint8_t type) {
+    switch (type) {
+    case ZMK_TRACE_POSITION:
+        return "position";
+    case ZMK_TRACE_KEYCODE:
+        return "keycode";
+    case ZMK_TRACE_HOLD_TAP:
+        return "hold-tap";
+    case ZMK_TRACE_DROPPED:
+        return "dropped";
+    }
+
+    return "UNKNOWN";
+}
+
+static void trace_send(const struct zmk_trace_record *record) {
+#if IS_ENABLED(CONFIG_ZMK_TRACE_UART)
+    const uint8_t *bytes = (const uint8_t *)record;
+
+    uart_poll_out(uart_dev, sizeof(*record));
+    for (int i = 0; i < sizeof(*record); i++) {
+        uart_poll_out(uart_dev, bytes[i]);
+    }
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TRACE_STDOUT)
+    printk("zmk_trace: t=%u %s position=%u layer=%u usage=0x%08x value=%u\n", record->timestamp,
+           type_str(record->type), record->position, record->layer, record->usage, record->value);
+#endif
+}
+
+static void trace_work_handler(struct k_work *work) {
+    while (true) {
+        struct zmk_trace_record record;
+
+        k_spinlock_key_t key = k_spin_lock(&records_lock);
+        if (records_tail == records_head) {
+            k_spin_unlock(&records_lock, key);
+            return;
+        }
+
+        record = records[records_tail++ % CONFIG_ZMK_TRACE_BUFFER_SIZE];
+        k_spin_unlock(&records_lock, key);
+
+        // Sending may be slow, so it happens outside the lock to not hold up new records.
+        trace_send(&record);
+    }
+}
+
+static inline void trace_write(uint8_t type, uint16_t position, uint32_t usage, uint8_t value,
+                               uint32_t timestamp) {
+    records[records_head++ % CONFIG_ZMK_TRACE_BUFFER_SIZE] = (struct zmk_trace_record){
+        .timestamp = timestamp,
+        .usage = usage,
+        .position = position,
+        .layer = zmk_keymap_highest_layer_active(),
+        .type = type,
+        .value = value,
+    };
+}
+
+void zmk_trace_record(enum zmk_trace_type type, uint16_t position, uint32_t usage, uint8_t value,
+                      int64_t timestamp) {
+    k_spinlock_key_t key = k_spin_lock(&records_lock);
+    uint32_t space = CONFIG_ZMK_TRACE_BUFFER_SIZE - (records_head - records_tail);
+
+    // After dropping records, the next record is preceded by a count of those dropped, so both need
+    // to fit.
+    if (space < (records_dropped ? 2 : 1)) {
+        records_dropped++;
+        k_spin_unlock(&records_lock, key);
+        return;
+    }
+
+    if (records_dropped) {
+        trace_write(ZMK_TRACE_DROPPED, ZMK_TRACE_NO_POSITION, records_dropped, 0, timestamp);
+        records_dropped = 0;
+    }
+
+    trace_write(type, position, usage, value, timestamp);
+    k_spin_unlock(&records_lock, key);
+
+    k_work_submit_to_queue(zmk_workqueue_lowprio_work_q(), &trace_work);
+}
+
+static int trace_listener(const zmk_event_t *eh) {
+    const struct zmk_position_state_changed *pos_ev = as_zmk_position_state_changed(eh);
+    if (pos_ev) {
+        zmk_trace_record(ZMK_TRACE_POSITION, pos_ev->position, 0, pos_ev->state,
+                         pos_ev->timestamp);
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    const struct zmk_keycode_state_changed *kc_ev = as_zmk_keycode_state_changed(eh);
+    if (kc_ev) {
+        zmk_trace_record(ZMK_TRACE_KEYCODE, ZMK_TRACE_NO_POSITION,
+                         ZMK_HID_USAGE(kc_ev->usage_page, kc_ev->keycode), kc_ev->state,
+                         kc_ev->timestamp);
+    }
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(trace, trace_listener);
+ZMK_SUBSCRIPTION(trace, zmk_position_state_changed);
+ZMK_SUBSCRIPTION(trace, zmk_keycode_state_changed);
+
+#if IS_ENABLED(CONFIG_ZMK_TRACE_UART)
+
+static int trace_uart_init(const struct device *_arg) {
+    if (!device_is_ready(uart_dev)) {
+        LOG_ERR("Trace UART device is not ready");
+        return -ENODEV;
+    }
+
+    return 0;
+}
+
+SYS_INIT(trace_uart_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_TRACE_UART) */
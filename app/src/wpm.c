@@ -4,9 +4,12 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <stdlib.h>
+
 #include <zephyr/device.h>
 #include <zephyr/init.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
 
 #include <zephyr/logging/log.h>
 
@@ -18,65 +21,94 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/wpm.h>
 
-#define WPM_UPDATE_INTERVAL_SECONDS 1
-#define WPM_RESET_INTERVAL_SECONDS 5
-
 // See https://en.wikipedia.org/wiki/Words_per_minute
 // "Since the length or duration of words is clearly variable, for the purpose of measurement of
 // text entry, the definition of each "word" is often standardized to be five characters or
 // keystrokes long in English"
-#define CHARS_PER_WORD 5.0
+#define CHARS_PER_WORD 5
+
+#define MS_PER_MINUTE 60000
 
 static uint8_t wpm_state = -1;
-static uint8_t last_wpm_state;
-static uint8_t wpm_update_counter;
-static uint32_t key_pressed_count;
+
+// Release times of the keystrokes within the window, oldest first, starting at keystrokes_start.
+static uint32_t keystrokes[CONFIG_ZMK_WPM_MAX_KEYSTROKES];
+static uint32_t keystrokes_start;
+static uint32_t keystrokes_len;
 
 int zmk_wpm_get_state(void) { return wpm_state; }
 
-int wpm_event_listener(const zmk_event_t *eh) {
-    const struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
-    if (ev) {
-        // count only key up events
-        if (!ev->state) {
-            key_pressed_count++;
-            LOG_DBG("key_pressed_count %d keycode %d", key_pressed_count, ev->keycode);
-        }
+static void wpm_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(wpm_work, wpm_work_handler);
+
+static uint8_t wpm_calculate(uint32_t now) {
+    while (keystrokes_len > 0 && now - keystrokes[keystrokes_start] >= CONFIG_ZMK_WPM_WINDOW_MS) {
+        keystrokes_start = (keystrokes_start + 1) % CONFIG_ZMK_WPM_MAX_KEYSTROKES;
+        keystrokes_len--;
     }
-    return 0;
+
+    if (keystrokes_len == 0) {
+        return 0;
+    }
+
+    uint32_t window_ms = CONFIG_ZMK_WPM_WINDOW_MS;
+
+    // When typing too fast to keep every keystroke in the window, measure over the time the kept
+    // keystrokes took instead.
+    if (keystrokes_len == CONFIG_ZMK_WPM_MAX_KEYSTROKES) {
+        window_ms = MAX(now - keystrokes[keystrokes_start], 1);
+    }
+
+    uint32_t divisor = CHARS_PER_WORD * window_ms;
+    uint32_t wpm = (keystrokes_len * MS_PER_MINUTE + divisor / 2) / divisor;
+
+    return MIN(wpm, UINT8_MAX);
 }
 
-void wpm_work_handler(struct k_work *work) {
-    wpm_update_counter++;
-    wpm_state = (key_pressed_count / CHARS_PER_WORD) /
-                (wpm_update_counter * WPM_UPDATE_INTERVAL_SECONDS / 60.0);
+static void wpm_work_handler(struct k_work *work) {
+    uint8_t wpm = wpm_calculate(k_uptime_get_32());
 
-    if (last_wpm_state != wpm_state) {
-        LOG_DBG("Raised WPM state changed %d wpm_update_counter %d", wpm_state, wpm_update_counter);
+    // Small changes are mostly noise from where keystrokes fall in the window, so only report
+    // larger ones, and always report when typing has stopped.
+    if (abs(wpm - wpm_state) >= CONFIG_ZMK_WPM_MIN_CHANGE || (wpm == 0 && wpm_state != 0)) {
+        LOG_DBG("Raised WPM state changed %d", wpm);
 
+        wpm_state = wpm;
         ZMK_EVENT_RAISE(
             new_zmk_wpm_state_changed((struct zmk_wpm_state_changed){.state = wpm_state}));
-
-        last_wpm_state = wpm_state;
     }
 
-    if (wpm_update_counter >= WPM_RESET_INTERVAL_SECONDS) {
-        wpm_update_counter = 0;
-        key_pressed_count = 0;
+    // Nothing can change until the next keystroke once the window is empty, so stop waking up.
+    if (keystrokes_len > 0) {
+        k_work_schedule(&wpm_work, K_MSEC(CONFIG_ZMK_WPM_UPDATE_INTERVAL_MS));
     }
 }
 
-K_WORK_DEFINE(wpm_work, wpm_work_handler);
-
-void wpm_expiry_function(struct k_timer *_timer) { k_work_submit(&wpm_work); }
-
-K_TIMER_DEFINE(wpm_timer, wpm_expiry_function, NULL);
+int wpm_event_listener(const zmk_event_t *eh) {
+    const struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
+    if (ev) {
+        // count only key up events
+        if (!ev->state) {
+            if (keystrokes_len == CONFIG_ZMK_WPM_MAX_KEYSTROKES) {
+                keystrokes_start = (keystrokes_start + 1) % CONFIG_ZMK_WPM_MAX_KEYSTROKES;
+                keystrokes_len--;
+            }
+
+            keystrokes[(keystrokes_start + keystrokes_len) % CONFIG_ZMK_WPM_MAX_KEYSTROKES] =
+                (uint32_t)ev->timestamp;
+            keystrokes_len++;
+            LOG_DBG("keystrokes in window %d keycode %d", keystrokes_len, ev->keycode);
+
+            // Does nothing if an update is already scheduled.
+            k_work_schedule(&wpm_work, K_MSEC(CONFIG_ZMK_WPM_UPDATE_INTERVAL_MS));
+        }
+    }
+    return 0;
+}
 
 int wpm_init(const struct device *_device) {
     wpm_state = 0;
-    wpm_update_counter = 0;
-    k_timer_start(&wpm_timer, K_SECONDS(WPM_UPDATE_INTERVAL_SECONDS),
-                  K_SECONDS(WPM_UPDATE_INTERVAL_SECONDS));
     return 0;
 }
 